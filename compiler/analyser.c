@@ -46,6 +46,7 @@ static struct node * new_node(struct analyser * a, int type) {
     p->literalstring = NULL;
     p->mode = a->mode;
     p->line_number = a->tokeniser->line_number;
+    p->file = a->tokeniser->file;
     p->type = type;
     return p;
 }
@@ -660,6 +661,7 @@ static struct node * make_among(struct analyser * a, struct node * p, struct nod
     x->used = false;
     x->shortest_size = INT_MAX;
     x->longest_size = 0;
+    x->profile = NULL;
 
     if (q->type == c_bra) {
         starter = q;
@@ -2012,6 +2014,615 @@ static void visit_routine(struct analyser * a, struct name * n) {
     visit_node(a, p);
 }
 
+/* Bounding how long the string can get while it's being stemmed.
+ *
+ * We follow the code from each external, keeping a bound on the length of
+ * the string of the form ratio * n + extra (where n is the length of the
+ * input word), and whatever we know about the length of the slice so that
+ * e.g. `[substring] among ( 'ies' (<-'y') )` isn't counted as growth.
+ * Routines are followed from each call.
+ *
+ * A loop which lengthens the string by a constant amount each time round is
+ * assumed to run at most once per symbol of the string it starts with, plus
+ * a final time which fails.  That holds for loops in real stemmers, which
+ * work along the string, but it isn't something we can check.  Code we
+ * can't bound (e.g. a loop which lengthens the string by an amount which
+ * depends on n, or recursion) means there's no bound.
+ */
+
+/* Limit on the values tracked, to avoid overflow. */
+#define LENGTH_BOUND_LIMIT 0x100000
+
+/* Ways a command can affect the slice. */
+#define SLICE_SETS_END 1     /* by ']' */
+#define SLICE_CHANGES 2      /* by '[', or by changing the string */
+
+struct length_bound {
+    int ratio;               /* -1 for no bound */
+    int extra;
+};
+
+struct slice_bound {
+    int min;                 /* lower bound on the length of the slice */
+    int max;                 /* upper bound, or -1 if not known */
+    struct node * substring; /* substring the slice is exactly, or NULL */
+    /* Tracking from '[' to the following ']'. */
+    int open;                /* is there an unmatched '['? */
+    int open_min;            /* bounds on what's been matched since */
+    int open_max;
+    int open_count;          /* number of commands since */
+    struct node * open_substring;
+};
+
+struct length_walker {
+    struct analyser * a;
+    struct length_bound * strings; /* bound for each string variable */
+    int strings_changed;
+    byte * active;           /* routines currently being followed */
+};
+
+static const struct length_bound no_length_bound = { -1, 0 };
+
+static struct length_bound length_bound_constant(int n) {
+    struct length_bound b = { 0, n };
+    return b;
+}
+
+static struct length_bound length_bound_make(long ratio, long extra) {
+    if (ratio > LENGTH_BOUND_LIMIT || extra > LENGTH_BOUND_LIMIT)
+        return no_length_bound;
+    struct length_bound b = { (int)ratio, (int)extra };
+    return b;
+}
+
+static struct length_bound length_bound_add(struct length_bound x,
+                                            struct length_bound y) {
+    if (x.ratio < 0 || y.ratio < 0) return no_length_bound;
+    return length_bound_make((long)x.ratio + y.ratio, (long)x.extra + y.extra);
+}
+
+static struct length_bound length_bound_max(struct length_bound x,
+                                            struct length_bound y) {
+    if (x.ratio < 0 || y.ratio < 0) return no_length_bound;
+    if (y.ratio > x.ratio) x.ratio = y.ratio;
+    if (y.extra > x.extra) x.extra = y.extra;
+    return x;
+}
+
+static int length_bound_equal(struct length_bound x, struct length_bound y) {
+    return x.ratio == y.ratio && x.extra == y.extra;
+}
+
+static void slice_unknown(struct slice_bound * s) {
+    s->min = 0;
+    s->max = -1;
+    s->substring = NULL;
+    s->open = false;
+}
+
+/* Maximum number of symbols one character of the input can take. */
+static int max_char_size(struct analyser * a) {
+    return a->encoding == ENC_UTF8 ? 4 : 1;
+}
+
+static int routine_index(struct length_walker * w, struct name * q) {
+    if (q->type == t_external) return w->a->name_count[t_routine] + q->count;
+    return q->count;
+}
+
+/* Bound on the length of the string inserted by p. */
+static struct length_bound inserted_length(struct length_walker * w,
+                                           struct node * p) {
+    if (p->literalstring) return length_bound_constant(SIZE(p->literalstring));
+    struct length_bound b = w->strings[p->name->count];
+    // A string variable keeps its value between words, so one which depends
+    // on n could hold a value from a longer word.
+    if (b.ratio != 0) return no_length_bound;
+    return b;
+}
+
+static void set_string_bound(struct length_walker * w, struct name * q,
+                             struct length_bound b) {
+    struct length_bound * s = &w->strings[q->count];
+    b = length_bound_max(*s, b);
+    if (!length_bound_equal(*s, b)) {
+        *s = b;
+        w->strings_changed = true;
+    }
+}
+
+static int slice_effects(struct length_walker * w, struct node * p);
+static int list_slice_effects(struct length_walker * w, struct node * p);
+
+/* Set *min and *max to bounds on how far command p moves the cursor if it
+ * succeeds (*max is -1 if not known). */
+static void match_bounds(struct length_walker * w, struct node * p,
+                         int * min, int * max) {
+    *min = 0;
+    *max = -1;
+    switch (p->type) {
+        case c_atlimit:
+        case c_atmark:
+        case c_booltest:
+        case c_not_booltest:
+        case c_do:
+        case c_not:
+        case c_set:
+        case c_setmark:
+        case c_test:
+        case c_true:
+        case c_unset:
+        case c_mathassign:
+        case c_plusassign:
+        case c_minusassign:
+        case c_multiplyassign:
+        case c_divideassign:
+        case c_eq:
+        case c_ne:
+        case c_gt:
+        case c_ge:
+        case c_lt:
+        case c_le:
+            *max = 0;
+            break;
+        case c_bra:
+            if (list_slice_effects(w, p->left) & SLICE_CHANGES) break;
+            *max = 0;
+            for (struct node * q = p->left; q; q = q->right) {
+                int q_min, q_max;
+                match_bounds(w, q, &q_min, &q_max);
+                *min += q_min;
+                if (q_max < 0 || *max < 0 || *max + q_max > LENGTH_BOUND_LIMIT) {
+                    *max = -1;
+                } else {
+                    *max += q_max;
+                }
+            }
+            break;
+        case c_or:
+            if (list_slice_effects(w, p->left) & SLICE_CHANGES) break;
+            *min = LENGTH_BOUND_LIMIT;
+            *max = 0;
+            for (struct node * q = p->left; q; q = q->right) {
+                int q_min, q_max;
+                match_bounds(w, q, &q_min, &q_max);
+                if (q_min < *min) *min = q_min;
+                if (q_max < 0 || *max < 0) {
+                    *max = -1;
+                } else if (q_max > *max) {
+                    *max = q_max;
+                }
+            }
+            break;
+        case c_among:
+            /* An action may move the cursor further. */
+            if (p->among->substring == NULL) {
+                struct among * x = p->among;
+                *min = x->longest_size;
+                for (int i = 0; i < x->literalstring_count; i++) {
+                    if (x->b[i].size < *min) *min = x->b[i].size;
+                }
+            }
+            break;
+        case c_literalstring:
+            *min = *max = SIZE(p->literalstring);
+            break;
+        case c_name:
+            if (p->name->type == t_string &&
+                w->strings[p->name->count].ratio == 0) {
+                *max = w->strings[p->name->count].extra;
+            }
+            break;
+        case c_next:
+        case c_non:
+            *min = 1;
+            *max = max_char_size(w->a);
+            break;
+        case c_grouping: {
+            int ch = p->name->grouping->largest_ch;
+            *min = 1;
+            if (w->a->encoding != ENC_UTF8 || ch < 0x80) {
+                *max = 1;
+            } else {
+                *max = ch < 0x800 ? 2 : ch < 0x10000 ? 3 : 4;
+            }
+            break;
+        }
+        case c_hop:
+            if (p->AE && p->AE->type == c_number) {
+                *min = p->AE->number;
+                *max = p->AE->number * max_char_size(w->a);
+            }
+            break;
+        case c_substring: {
+            struct among * x = p->among;
+            *min = x->longest_size;
+            for (int i = 0; i < x->literalstring_count; i++) {
+                if (x->b[i].size < *min) *min = x->b[i].size;
+            }
+            *max = x->longest_size;
+            break;
+        }
+    }
+}
+
+static int slice_effects(struct length_walker * w, struct node * p);
+
+static int list_slice_effects(struct length_walker * w, struct node * p) {
+    int effects = 0;
+    for ( ; p; p = p->right) {
+        effects |= slice_effects(w, p);
+    }
+    return effects;
+}
+
+static int routine_slice_effects(struct length_walker * w, struct name * q) {
+    int i = routine_index(w, q);
+    if (w->active[i]) return SLICE_SETS_END | SLICE_CHANGES;
+    w->active[i] = true;
+    int effects = list_slice_effects(w, q->definition);
+    w->active[i] = false;
+    return effects;
+}
+
+static int slice_effects(struct length_walker * w, struct node * p) {
+    switch (p->type) {
+        case c_rightslice:
+            return SLICE_SETS_END;
+        case c_leftslice:
+        case c_slicefrom:
+        case c_delete:
+        case c_insert:
+        case c_attach:
+        case c_assign:
+            return SLICE_CHANGES;
+        case c_dollar:
+            /* The slice is restored afterwards. */
+        case c_mathassign:
+        case c_plusassign:
+        case c_minusassign:
+        case c_multiplyassign:
+        case c_divideassign:
+        case c_eq:
+        case c_ne:
+        case c_gt:
+        case c_ge:
+        case c_lt:
+        case c_le:
+            return 0;
+        case c_call:
+            return routine_slice_effects(w, p->name);
+        case c_among: {
+            struct among * x = p->among;
+            int effects = 0;
+            for (int i = 0; i < x->literalstring_count; i++) {
+                if (x->b[i].function) {
+                    effects |= routine_slice_effects(w, x->b[i].function);
+                }
+            }
+            for (int i = 0; i < x->command_count; i++) {
+                effects |= slice_effects(w, x->commands[i]);
+            }
+            return effects;
+        }
+    }
+    return list_slice_effects(w, p->left) | list_slice_effects(w, p->aux);
+}
+
+#define may_change_slice(W, P) (slice_effects(W, P) != 0)
+
+/* The effects command p may have had on the slice if it fails. */
+static int failed_effects(struct length_walker * w, struct node * p) {
+    if (p->possible_signals == 1) return 0;
+    if (p->type != c_bra) return slice_effects(w, p);
+    int effects = 0;
+    int result = 0;
+    for (p = p->left; p; p = p->right) {
+        if (p->possible_signals != 1) {
+            result |= effects | failed_effects(w, p);
+        }
+        effects |= slice_effects(w, p);
+    }
+    return result;
+}
+
+static void length_of(struct length_walker * w, struct node * p,
+                      struct slice_bound * s, struct length_bound * len);
+
+static void length_of_list(struct length_walker * w, struct node * p,
+                           struct slice_bound * s, struct length_bound * len) {
+    for ( ; p; p = p->right) {
+        length_of(w, p, s, len);
+        if (s->open && p->type != c_leftslice) {
+            int min = 0, max = 0;
+            /* What's matched inside these has been counted already. */
+            if (p->type != c_bra && p->type != c_call) {
+                match_bounds(w, p, &min, &max);
+            }
+            s->open_min += min;
+            if (max < 0 || s->open_max < 0 ||
+                s->open_max + max > LENGTH_BOUND_LIMIT) {
+                s->open_max = -1;
+            } else {
+                s->open_max += max;
+            }
+            if (s->open_count++ == 0 && p->type == c_substring) {
+                s->open_substring = p;
+            } else {
+                s->open_substring = NULL;
+            }
+        }
+    }
+}
+
+static void length_of_routine(struct length_walker * w, struct name * q,
+                              struct slice_bound * s,
+                              struct length_bound * len) {
+    int i = routine_index(w, q);
+    if (w->active[i]) {
+        /* Recursion. */
+        *len = no_length_bound;
+        slice_unknown(s);
+        return;
+    }
+    w->active[i] = true;
+    length_of_list(w, q->definition, s, len);
+    w->active[i] = false;
+}
+
+/* Loop p runs its body count times, or if count is -1 at most once per
+ * symbol of the string plus once more, or if count is -2 an unknown number
+ * of times. */
+static void length_of_loop(struct length_walker * w, struct node * p,
+                           int count,
+                           struct slice_bound * s, struct length_bound * len) {
+    int changes_slice = list_slice_effects(w, p->left) != 0;
+    struct slice_bound t = *s;
+    struct length_bound after = *len;
+    if (changes_slice) slice_unknown(&t);
+    length_of_list(w, p->left, &t, &after);
+    if (changes_slice) {
+        /* If goto or gopast succeeds, the last time round did too. */
+        if (p->type == c_goto || p->type == c_gopast) {
+            *s = t;
+        } else {
+            slice_unknown(s);
+        }
+    }
+
+    if (length_bound_equal(after, *len)) return;
+    if (after.ratio != len->ratio || count == -2) {
+        *len = no_length_bound;
+        return;
+    }
+    long c = after.extra - len->extra;
+    if (count >= 0) {
+        *len = length_bound_make(len->ratio, len->extra + c * count);
+    } else {
+        *len = length_bound_make(len->ratio * (1 + c),
+                                 len->extra * (1 + c) + c);
+    }
+}
+
+static void length_of(struct length_walker * w, struct node * p,
+                      struct slice_bound * s, struct length_bound * len) {
+    switch (p->type) {
+        case c_leftslice:
+            slice_unknown(s);
+            s->open = true;
+            s->open_min = s->open_max = 0;
+            s->open_count = 0;
+            s->open_substring = NULL;
+            return;
+        case c_rightslice:
+            if (s->open) {
+                s->min = s->open_min;
+                s->max = s->open_max;
+                s->substring = s->open_count == 1 ? s->open_substring : NULL;
+                /* A later ']' can extend the slice. */
+            } else {
+                slice_unknown(s);
+            }
+            return;
+        case c_slicefrom: {
+            struct length_bound b = inserted_length(w, p);
+            if (b.ratio == 0) {
+                if (b.extra > s->min) {
+                    *len = length_bound_add(*len,
+                                            length_bound_constant(b.extra - s->min));
+                }
+                s->min = s->max = b.extra;
+            } else {
+                *len = no_length_bound;
+                s->min = 0;
+                s->max = -1;
+            }
+            s->substring = NULL;
+            s->open = false;
+            return;
+        }
+        case c_delete:
+            s->min = s->max = 0;
+            s->substring = NULL;
+            s->open = false;
+            return;
+        case c_insert:
+        case c_attach:
+            *len = length_bound_add(*len, inserted_length(w, p));
+            s->max = -1;
+            s->substring = NULL;
+            s->open = false;
+            return;
+        case c_assign:
+            *len = length_bound_add(*len, inserted_length(w, p));
+            slice_unknown(s);
+            return;
+        case c_sliceto:
+            set_string_bound(w, p->name,
+                             s->max >= 0 ? length_bound_constant(s->max) : *len);
+            return;
+        case c_assignto:
+            set_string_bound(w, p->name, *len);
+            return;
+        case c_dollar: {
+            struct slice_bound t;
+            struct length_bound b = w->strings[p->name->count];
+            slice_unknown(&t);
+            length_of_list(w, p->left, &t, &b);
+            set_string_bound(w, p->name, b);
+            return;
+        }
+        case c_call:
+            length_of_routine(w, p->name, s, len);
+            return;
+        case c_among: {
+            struct among * x = p->among;
+            struct length_bound result;
+            /* Any of the functions could be called before the action. */
+            for (int i = 0; i < x->literalstring_count; i++) {
+                if (x->b[i].function) {
+                    struct slice_bound t = *s;
+                    length_of_routine(w, x->b[i].function, &t, len);
+                }
+            }
+            result = *len;
+            for (int k = 0; k < x->command_count; k++) {
+                struct slice_bound t = *s;
+                struct length_bound after = *len;
+                int min = LENGTH_BOUND_LIMIT, max = 0;
+                for (int i = 0; i < x->literalstring_count; i++) {
+                    if (x->b[i].result != k + 1) continue;
+                    if (x->b[i].size < min) min = x->b[i].size;
+                    if (x->b[i].size > max) max = x->b[i].size;
+                }
+                if (x->substring) {
+                    if (s->substring == x->substring) {
+                        /* The slice is the string matched for this action. */
+                        t.min = min;
+                        t.max = max;
+                    }
+                } else if (t.open) {
+                    /* The among has matched one of these strings. */
+                    t.open_min += min;
+                    t.open_max = t.open_max < 0 ? -1 : t.open_max + max;
+                    t.open_count++;
+                    t.open_substring = NULL;
+                }
+                length_of(w, x->commands[k], &t, &after);
+                result = length_bound_max(result, after);
+            }
+            *len = result;
+            if (may_change_slice(w, p)) slice_unknown(s);
+            return;
+        }
+        case c_repeat:
+        case c_atleast:
+            if (p->left->type == c_goto || p->left->type == c_gopast) {
+                /* Treat `repeat goto C` as one loop, since each time round
+                 * carries on from where the last left off. */
+                length_of_loop(w, p->left, -1, s, len);
+                if (may_change_slice(w, p)) slice_unknown(s);
+                return;
+            }
+            length_of_loop(w, p, -1, s, len);
+            return;
+        case c_goto:
+        case c_gopast:
+            length_of_loop(w, p, -1, s, len);
+            return;
+        case c_loop:
+            if (p->AE && p->AE->type == c_number) {
+                length_of_loop(w, p, p->AE->number, s, len);
+            } else {
+                length_of_loop(w, p, -2, s, len);
+            }
+            return;
+        case c_bra:
+            length_of_list(w, p->left, s, len);
+            return;
+        case c_or: {
+            /* Each alternative starts with the cursor where the or did, but
+             * an earlier one may have changed the slice before failing. */
+            struct slice_bound entry = *s;
+            int effects = 0;
+            int failed = 0;
+            for (struct node * q = p->left; q; q = q->right) {
+                struct slice_bound t = entry;
+                if (failed & SLICE_CHANGES) {
+                    slice_unknown(&t);
+                } else if (failed) {
+                    t.min = 0;
+                    t.max = -1;
+                    t.substring = NULL;
+                }
+                length_of(w, q, &t, len);
+                effects |= slice_effects(w, q);
+                failed |= failed_effects(w, q);
+            }
+            if (effects) slice_unknown(s);
+            return;
+        }
+        case c_and:
+        case c_backwards:
+        case c_do:
+        case c_fail:
+        case c_not:
+        case c_reverse:
+        case c_setlimit:
+        case c_test:
+        case c_try: {
+            /* Conservatively, as if each part runs in turn. */
+            struct slice_bound t = *s;
+            length_of_list(w, p->left, &t, len);
+            length_of_list(w, p->aux, &t, len);
+            if (may_change_slice(w, p)) slice_unknown(s);
+            return;
+        }
+    }
+}
+
+static void find_max_length(struct analyser * a) {
+    struct length_walker w;
+    int string_count = a->name_count[t_string];
+    int routine_count = a->name_count[t_routine] + a->name_count[t_external];
+    struct length_bound result = length_bound_constant(0);
+
+    w.a = a;
+    w.strings = (struct length_bound *)
+        MALLOC((string_count + 1) * sizeof(struct length_bound));
+    for (int i = 0; i < string_count; i++) {
+        w.strings[i] = length_bound_constant(0);
+    }
+    w.active = (byte *) MALLOC(routine_count + 1);
+    memset(w.active, 0, routine_count + 1);
+
+    /* String variables can be set after they're used (e.g. in a loop) so
+     * repeat until their bounds stop changing. */
+    for (int pass = 0; pass < 4; pass++) {
+        w.strings_changed = false;
+        result = length_bound_constant(0);
+        for (struct name * q = a->names; q; q = q->next) {
+            if (q->type != t_external) continue;
+            struct slice_bound s;
+            struct length_bound len = { 1, 0 };
+            slice_unknown(&s);
+            length_of_list(&w, q->definition, &s, &len);
+            result = length_bound_max(result, len);
+        }
+        if (!w.strings_changed) break;
+    }
+    if (w.strings_changed) result = no_length_bound;
+    /* String variables need buffers too. */
+    for (int i = 0; i < string_count; i++) {
+        result = length_bound_max(result, w.strings[i]);
+    }
+
+    a->max_length_ratio = result.ratio;
+    a->max_length_extra = result.extra;
+    FREE(w.strings);
+    FREE(w.active);
+}
+
 extern void read_program(struct analyser * a) {
     read_program_(a, -1);
     for (struct name * q = a->names; q; q = q->next) {
@@ -2173,6 +2784,7 @@ extern void read_program(struct analyser * a) {
             a_ptr = &(x->next);
         }
     }
+    find_max_length(a);
 }
 
 extern struct analyser * create_analyser(struct tokeniser * t) {
@@ -2191,6 +2803,8 @@ extern struct analyser * create_analyser(struct tokeniser * t) {
     a->substring = NULL;
     a->current_routine = NULL;
     a->int_limits_used = false;
+    a->max_length_ratio = -1;
+    a->max_length_extra = 0;
     return a;
 }
 
@@ -2226,6 +2840,7 @@ extern void close_analyser(struct analyser * a) {
             struct among * q_next = q->next;
             FREE(q->b);
             FREE(q->commands);
+            if (q->profile) FREE(q->profile);
             FREE(q);
             q = q_next;
         }
@@ -37,6 +37,20 @@ static void print_arglist(int exit_code) {
                "  -o, -output OUTPUT_BASE\n"
                "  -s, -syntax                      show syntax tree and stop\n"
                "  -comments                        generate comments\n"
+               "  -line-directives                 generate #line directives referring to\n"
+               "                                   the Snowball source (C/C++)\n"
+               "  -trie                            use tries for among lookups (C/C++)\n"
+               "  -packed                          use packed among tables without pointers\n"
+               "                                   (C/C++)\n"
+               "  -inline                          inline grouping tests, string tests and\n"
+               "                                   slice replacements (C/C++)\n"
+               "  -struct-env                      keep variables in named fields of a\n"
+               "                                   per-algorithm struct (C/C++)\n"
+               "  -ascii                           add a variant for ASCII input (C/C++ with -u)\n"
+               "  -profile                         count routine calls, among matches and\n"
+               "                                   grouping tests (C/C++)\n"
+               "  -profile-use PROFILE_FILE        optimise among lookups using counts\n"
+               "                                   from -profile (C/C++)\n"
 #ifndef DISABLE_JAVA
                "  -j, -java                        generate Java\n"
 #endif
@@ -106,6 +120,78 @@ static FILE * get_output(byte * s) {
     return output;
 }
 
+/* Read the among counts written by the dump_profile() function of code
+ * generated with -profile.  Each line for an among entry also gives its
+ * string, which we check so that a profile from a different version of the
+ * source is ignored rather than misapplied.
+ */
+static void read_profile(struct analyser * a, const char * filename) {
+    FILE * f = fopen(filename, "r");
+    char line[1024];
+    int line_number = 0;
+    if (f == NULL) {
+        fprintf(stderr, "Can't open profile %s\n", filename);
+        exit(1);
+    }
+    while (fgets(line, sizeof(line), f)) {
+        int number, index = 0, n;
+        /* Read as signed so that a negative count can be rejected (%lu
+         * would silently wrap it). */
+        long count;
+        /* Set for the count of lookups which matched no entry. */
+        int miss = 0;
+        struct among * x;
+        ++line_number;
+        if (sscanf(line, "among %d %n", &number, &n) != 1) continue;
+        if (line[n] == '-' && isspace((unsigned char)line[n + 1])) {
+            /* Not "-5", which is an (invalid) index. */
+            if (sscanf(line + n + 1, "%ld", &count) != 1) continue;
+            miss = 1;
+        } else {
+            int start = n;
+            if (sscanf(line + start, "%d %ld %n", &index, &count, &n) != 2) continue;
+            n += start;
+        }
+        if (count < 0) {
+            fprintf(stderr, "%s:%d: negative count\n", filename, line_number);
+            continue;
+        }
+        for (x = a->amongs; x; x = x->next) {
+            if (x->number == number) break;
+        }
+        if (x == NULL ||
+            (!miss && (index < 0 || index >= x->literalstring_count))) {
+            fprintf(stderr, "%s:%d: no matching among in source\n",
+                    filename, line_number);
+            continue;
+        }
+        if (!miss) {
+            /* Compare the string (which ends at a newline). */
+            struct amongvec * v = x->b + index;
+            int len = (int)strcspn(line + n, "\r\n");
+            int i = 0;
+            if (len == v->size) {
+                for (i = 0; i < len; i++) {
+                    if (v->b[i] != (unsigned char)line[n + i]) break;
+                }
+            }
+            if (len != v->size || i < len) {
+                fprintf(stderr, "%s:%d: string doesn't match among entry in source\n",
+                        filename, line_number);
+                continue;
+            }
+        } else {
+            index = x->literalstring_count;
+        }
+        if (x->profile == NULL) {
+            x->profile = (unsigned long *)MALLOC(sizeof(unsigned long) * (x->literalstring_count + 1));
+            for (int j = 0; j <= x->literalstring_count; j++) x->profile[j] = 0;
+        }
+        x->profile[index] += (unsigned long)count;
+    }
+    fclose(f);
+}
+
 static int read_options(struct options * o, int argc, char * argv[]) {
     int i = 1;
     int new_argc = 1;
@@ -119,6 +205,14 @@ static int read_options(struct options * o, int argc, char * argv[]) {
     o->output_file = NULL;
     o->syntax_tree = false;
     o->comments = false;
+    o->line_directives = false;
+    o->inline_tests = false;
+    o->struct_env = false;
+    o->among_trie = false;
+    o->among_packed = false;
+    o->ascii_variant = false;
+    o->profile = false;
+    o->profile_use = NULL;
     o->externals_prefix = NULL;
     o->variables_prefix = NULL;
     o->runtime_path = NULL;
@@ -234,6 +328,39 @@ static int read_options(struct options * o, int argc, char * argv[]) {
                 o->comments = true;
                 continue;
             }
+            if (eq(s, "-line-directives")) {
+                o->line_directives = true;
+                continue;
+            }
+            if (eq(s, "-inline")) {
+                o->inline_tests = true;
+                continue;
+            }
+            if (eq(s, "-struct-env")) {
+                o->struct_env = true;
+                continue;
+            }
+            if (eq(s, "-trie")) {
+                o->among_trie = true;
+                continue;
+            }
+            if (eq(s, "-packed")) {
+                o->among_packed = true;
+                continue;
+            }
+            if (eq(s, "-ascii")) {
+                o->ascii_variant = true;
+                continue;
+            }
+            if (eq(s, "-profile")) {
+                o->profile = true;
+                continue;
+            }
+            if (eq(s, "-profile-use")) {
+                check_lim(i, argc);
+                o->profile_use = argv[i++];
+                continue;
+            }
             if (eq(s, "-ep") || eq(s, "-eprefix")) {
                 check_lim(i, argc);
                 o->externals_prefix = argv[i++];
@@ -400,6 +527,32 @@ static int read_options(struct options * o, int argc, char * argv[]) {
         if (o->variables_prefix) {
             fprintf(stderr, "warning: -vp/-vprefix only meaningful for C and C++\n");
         }
+        if (o->line_directives) {
+            fprintf(stderr, "warning: -line-directives only meaningful for C and C++\n");
+        }
+        if (o->among_trie) {
+            fprintf(stderr, "warning: -trie only meaningful for C and C++\n");
+        }
+        if (o->among_packed) {
+            fprintf(stderr, "warning: -packed only meaningful for C and C++\n");
+        }
+        if (o->inline_tests) {
+            fprintf(stderr, "warning: -inline only meaningful for C and C++\n");
+        }
+        if (o->struct_env) {
+            fprintf(stderr, "warning: -struct-env only meaningful for C and C++\n");
+        }
+        if (o->ascii_variant) {
+            fprintf(stderr, "warning: -ascii only meaningful for C and C++\n");
+        }
+        if (o->profile) {
+            fprintf(stderr, "warning: -profile only meaningful for C and C++\n");
+        }
+        if (o->profile_use) {
+            fprintf(stderr, "warning: -profile-use only meaningful for C and C++\n");
+        }
+    } else if (o->ascii_variant && o->encoding != ENC_UTF8) {
+        fprintf(stderr, "warning: -ascii only meaningful with -u/-utf8\n");
     }
     if (!o->externals_prefix) o->externals_prefix = "";
 
@@ -506,6 +659,7 @@ extern int main(int argc, char * argv[]) {
             *next_input_ptr = NULL;
             read_program(a);
             if (t->error_count > 0) exit(1);
+            if (o->profile_use) read_profile(a, o->profile_use);
             if (o->syntax_tree) print_program(a);
             if (!o->syntax_tree) {
                 struct generator * g;
@@ -1,4 +1,5 @@
 #include <assert.h>
+#include <limits.h>  /* for INT_MAX */
 #include <stdio.h>   /* for fprintf etc */
 #include <stdlib.h>  /* for free etc */
 #include <string.h>  /* for strlen */
@@ -12,6 +13,7 @@
 static void generate(struct generator * g, struct node * p);
 static void w(struct generator * g, const char * s);
 static void writef(struct generator * g, const char * s, struct node * p);
+static void write_find_among(struct generator * g, struct node * p);
 
 static int new_label(struct generator * g) {
     return g->next_label++;
@@ -51,6 +53,12 @@ static void write_varname(struct generator * g, struct name * p) {
                         p->s);
                 exit(1);
             }
+            if (g->options->struct_env) {
+                /* A field of the state struct. */
+                write_char(g, "SBI"[p->type]);
+                write_char(g, '_');
+                break;
+            }
             if (p->type == t_boolean) {
                 /* We use a single array for booleans and integers, with the
                  * integers first.
@@ -64,13 +72,24 @@ static void write_varname(struct generator * g, struct name * p) {
             return;
         }
         default:
-            write_char(g, ch); write_char(g, '_');
+            write_char(g, ch);
+            if (g->ascii_variant && p->type == t_routine) write_char(g, 'a');
+            write_char(g, '_');
     }
     write_s(g, p->s);
+    if (g->ascii_variant && p->type == t_external) write_string(g, "_ascii");
 }
 
 static void write_varref(struct generator * g, struct name * p) {  /* reference to variable */
-    if (p->type < t_routine) write_string(g, "z->");
+    if (p->type < t_routine) {
+        if (g->options->struct_env) {
+            write_string(g, "((struct ");
+            write_string(g, g->options->externals_prefix);
+            write_string(g, "env *) z)->");
+        } else {
+            write_string(g, "z->");
+        }
+    }
     write_varname(g, p);
 }
 
@@ -114,12 +133,16 @@ static void wlitref(struct generator * g, symbol * p) {  /* write ref to literal
     if (SIZE(p) == 0) {
         write_char(g, '0');
     } else {
-        struct str * s = g->outbuf;
-        g->outbuf = g->declarations;
-        write_string(g, "static const symbol s_"); write_int(g, g->literalstring_count); write_string(g, "[] = ");
-        wlitarray(g, p);
-        write_string(g, ";\n");
-        g->outbuf = s;
+        /* The ASCII variant visits the literals in the same order, so can
+         * share the declarations made for the UTF-8 code. */
+        if (!g->ascii_variant) {
+            struct str * s = g->outbuf;
+            g->outbuf = g->declarations;
+            write_string(g, "static const symbol s_"); write_int(g, g->literalstring_count); write_string(g, "[] = ");
+            wlitarray(g, p);
+            write_string(g, ";\n");
+            g->outbuf = s;
+        }
         write_string(g, "s_"); write_int(g, g->literalstring_count);
         g->literalstring_count++;
     }
@@ -186,13 +209,36 @@ void write_comment_content(struct generator * g, struct node * p) {
     write_int(g, p->line_number);
 }
 
+/* Write a #line directive so that the C compiler (and so debuggers and
+ * profilers) attribute the following code to the given line of file. */
+static void write_line_directive(struct generator * g, int line,
+                                 const char * file, const char * suffix) {
+    if (str_len(g->outbuf) && str_back(g->outbuf) != '\n') write_newline(g);
+    write_string(g, "#line ");
+    write_int(g, line);
+    write_string(g, " \"");
+    for (const char * s = file; *s; s++) {
+        if (*s == '\\' || *s == '"') write_char(g, '\\');
+        write_char(g, *s);
+    }
+    write_string(g, suffix);
+    write_char(g, '"');
+    /* Not write_newline() as a directive isn't a statement so mustn't count
+     * as a line after a label (see write_block_end()). */
+    str_append_ch(g->outbuf, '\n');
+}
+
 static void write_comment(struct generator * g, struct node * p) {
-    if (!g->options->comments) return;
-    write_margin(g);
-    write_string(g, "/* ");
-    write_comment_content(g, p);
-    write_string(g, " */");
-    write_newline(g);
+    if (g->options->comments) {
+        write_margin(g);
+        write_string(g, "/* ");
+        write_comment_content(g, p);
+        write_string(g, " */");
+        write_newline(g);
+    }
+    if (g->options->line_directives) {
+        write_line_directive(g, p->line_number, p->file, "");
+    }
 }
 
 /* margin + string */
@@ -317,6 +363,21 @@ static void writef(struct generator * g, const char * input, struct node * p) {
                 write_s(g, g->B[j]);
                 continue;
             }
+            case 'G': // Grouping test suffix and leading arguments.
+                if (g->options->encoding == ENC_UTF8) {
+                    w(g, g->options->inline_tests ? "_TU_i(z, gt_" : "_TU(z, gt_");
+                    write_s(g, p->name->s);
+                    w(g, ", ");
+                    write_varname(g, p->name);
+                    w(g, ", ~I0, ~I1");
+                } else {
+                    w(g, g->options->inline_tests ? "_T_i(z, gt_" : "_T(z, gt_");
+                    write_s(g, p->name->s);
+                }
+                continue;
+            case 'A': // Among lookup.
+                write_find_among(g, p);
+                continue;
             case 'F': { // Among function dispatcher.
                 struct among * x = p->among;
                 if (x->function_count == 0) {
@@ -339,7 +400,7 @@ continue_outer_loop:
                     continue;
                 }
 
-                w(g, "af_");
+                w(g, g->ascii_variant ? "afa_" : "af_");
                 write_int(g, x->number);
                 continue;
             }
@@ -376,6 +437,9 @@ continue_outer_loop:
                 write_char(g, p->literalstring == NULL ? 'v' : 's');
                 continue;
             case 'p': write_string(g, g->options->externals_prefix); continue;
+            case 'i': // Suffix for the inline version of a runtime function.
+                if (g->options->inline_tests) write_string(g, "_i");
+                continue;
             default:
                 printf("Invalid escape sequence ~%c in writef(g, \"%s\", p)\n",
                        ch, input);
@@ -843,20 +907,35 @@ static void generate_next(struct generator * g, struct node * p) {
     }
 }
 
+/* With -profile, each routine and grouping has a counter.  The routines
+ * are numbered with the externals after the internal routines.
+ */
+static int profile_routine_index(struct generator * g, struct name * q) {
+    if (q->type == t_external)
+        return g->analyser->name_count[t_routine] + q->count;
+    return q->count;
+}
+
+static void write_profile_grouping(struct generator * g, struct grouping * q) {
+    if (!g->options->profile) return;
+    g->I[0] = q->name->count;
+    w(g, "~Mprof_g[~I0]++;~N");
+}
+
 static void generate_GO_grouping(struct generator * g, struct node * p, int is_goto, int complement) {
     write_comment(g, p);
 
     struct grouping * q = p->name->grouping;
+    write_profile_grouping(g, q);
     g->S[0] = p->mode == m_forward ? "" : "_b";
     g->S[1] = complement ? "in" : "out";
-    g->S[2] = g->options->encoding == ENC_UTF8 ? "_U" : "";
     g->I[0] = q->smallest_ch;
     g->I[1] = q->largest_ch;
     if (is_goto) {
-        writef(g, "~Mif (~S1_grouping~S0~S2(z, ~V, ~I0, ~I1, 1) < 0) ~f~N", p);
+        writef(g, "~Mif (~S1_grouping~S0~G, 1) < 0) ~f~N", p);
     } else {
         writef(g, "~{"
-              "~Mint ret = ~S1_grouping~S0~S2(z, ~V, ~I0, ~I1, 1);~N"
+              "~Mint ret = ~S1_grouping~S0~G, 1);~N"
               "~Mif (ret < 0) ~f~N", p);
         if (p->mode == m_forward)
             w(g, "~Mz->c += ret;~N");
@@ -1117,7 +1196,11 @@ static void generate_assignfrom(struct generator * g, struct node * p) {
 
 static void generate_slicefrom(struct generator * g, struct node * p) {
     write_comment(g, p);
-    writef(g, "~{~Mint ret = slice_from_~$(z, ~a);~N", p);
+    if (p->literalstring) {
+        writef(g, "~{~Mint ret = slice_from_s~i(z, ~a);~N", p);
+    } else {
+        writef(g, "~{~Mint ret = slice_from_v(z, ~a);~N", p);
+    }
     writef(g, "~Mif (ret < 0) return ret;~N~}", p);
 }
 
@@ -1229,6 +1312,7 @@ static void generate_dollar(struct generator * g, struct node * p) {
 
     g->B[0] = str_data(savevar);
     writef(g, "~M~V = z->p;~N"
+          "~Men~B0.reallocs = z->reallocs;~N"
           "~M* z = en~B0;~N"
           "~Mif (failure) ~f~N~}", p);
     str_delete(savevar);
@@ -1299,12 +1383,12 @@ static void generate_grouping(struct generator * g, struct node * p, int complem
     write_comment(g, p);
 
     struct grouping * q = p->name->grouping;
+    write_profile_grouping(g, q);
     g->S[0] = p->mode == m_forward ? "" : "_b";
     g->S[1] = complement ? "out" : "in";
-    g->S[2] = g->options->encoding == ENC_UTF8 ? "_U" : "";
     g->I[0] = q->smallest_ch;
     g->I[1] = q->largest_ch;
-    writef(g, "~Mif (~S1_grouping~S0~S2(z, ~V, ~I0, ~I1, 0)) ~f~N", p);
+    writef(g, "~Mif (~S1_grouping~S0~G, 0)) ~f~N", p);
 }
 
 static void generate_namedstring(struct generator * g, struct node * p) {
@@ -1336,7 +1420,7 @@ static void generate_literalstring(struct generator * g, struct node * p) {
         }
     } else {
         g->S[0] = p->mode == m_forward ? "" : "_b";
-        writef(g, "~Mif (!(eq_s~S0(z, ~s, ~L))) ~f~N", p);
+        writef(g, "~Mif (!(eq_s~S0~i(z, ~s, ~L))) ~f~N", p);
     }
 }
 
@@ -1354,6 +1438,10 @@ static void generate_define(struct generator * g, struct node * p) {
 
     writef(g, "~S0 int ~V(struct SN_env * z) {~N~+", p);
     if (q->amongvar_needed) w(g, "~Mint among_var;~N");
+    if (g->options->profile) {
+        g->I[0] = profile_routine_index(g, q);
+        w(g, "~Mprof_r[~I0]++;~N");
+    }
     str_clear(g->failure_str);
     g->failure_label = x_return;
     g->label_used = 0;
@@ -1374,10 +1462,438 @@ static void generate_functionend(struct generator * g, struct node * p) {
     w(g, "~Mreturn 1;~N");
 }
 
+/* Tries for among lookups.
+ *
+ * With the -trie option each among also gets a trie of its strings (walked
+ * forwards or backwards from the cursor as appropriate), which the runtime
+ * find_among_trie() and find_among_trie_b() use instead of a binary search.
+ * The nodes are numbered in breadth-first order, so the children of each node
+ * are consecutive and the target of edge j is always node j + 1 - this means
+ * we only need to store the first edge of each node, the character for each
+ * edge, and the among entry (if any) which ends at each node.
+ */
+
+static int among_trie_size(struct among * x) {
+    int size = 1;
+    for (int i = 0; i < x->literalstring_count; i++) size += x->b[i].size;
+    return size;
+}
+
+static int among_uses_trie(struct generator * g, struct among * x) {
+    /* The trie tables use unsigned short for node and entry numbers. */
+    /* The profiling lookups don't use the trie. */
+    return g->options->among_trie && !g->options->profile &&
+           among_trie_size(x) <= 0xffff &&
+           x->literalstring_count < 0xffff;
+}
+
+/* Packed among tables.
+ *
+ * With the -packed option the strings of an among are stored one after
+ * another in a single array (as_N), with a string which occurs within one
+ * already there sharing its symbols, and the entries of a_N (struct
+ * among_packed) give the offset of each string and use narrow fields for the
+ * rest.  The tables then contain no pointers, so need no relocations in a
+ * shared library, and take a third of the space.  An among whose values
+ * don't fit, or which uses a trie, keeps the usual table.
+ */
+
+static int among_uses_packed(struct generator * g, struct among * x) {
+    /* The profiling lookups use struct among. */
+    if (!g->options->among_packed || g->options->profile) return false;
+    if (among_uses_trie(g, x)) return false;
+    if (x->literalstring_count > 0xffff || x->function_count > 0xff) {
+        return false;
+    }
+    int pool_size = 0;
+    for (int i = 0; i < x->literalstring_count; i++) {
+        struct amongvec * v = x->b + i;
+        if (v->size > 0xff) return false;
+        if (v->result < -0x8000 || v->result > 0x7fff) return false;
+        pool_size += v->size;
+    }
+    /* Offsets are unsigned short. */
+    return pool_size <= 0x10000;
+}
+
+/* Build the string pool for x, setting offsets[i] to the offset of the string
+ * for entry i. */
+static symbol * among_pool(struct among * x, int * offsets) {
+    struct amongvec * v = x->b;
+    int n = x->literalstring_count;
+    int * order = (int *) MALLOC(n * sizeof(int));
+    symbol * pool = create_b(0);
+
+    /* Add the longest strings first so the shorter ones can often share
+     * their symbols. */
+    for (int i = 0; i < n; i++) {
+        int k = i;
+        while (k > 0 && v[order[k - 1]].size < v[i].size) {
+            order[k] = order[k - 1];
+            k--;
+        }
+        order[k] = i;
+    }
+    for (int k = 0; k < n; k++) {
+        int i = order[k];
+        int size = v[i].size;
+        int offset = -1;
+        for (int j = 0; j + size <= SIZE(pool); j++) {
+            if (memcmp(pool + j, v[i].b, size * sizeof(symbol)) == 0) {
+                offset = j;
+                break;
+            }
+        }
+        if (offset < 0) {
+            offset = SIZE(pool);
+            pool = add_to_b(pool, v[i].b, size);
+        }
+        offsets[i] = offset;
+    }
+    FREE(order);
+    return pool;
+}
+
+/* Profile-guided fast paths for among lookups.
+ *
+ * With -profile-use, entries which the profile shows match a good share of
+ * the lookups are tested for directly with eq_s()/eq_s_b() before the table
+ * lookup.  This only gives the same result as the lookup if the entry is the
+ * longest match whenever it matches, which is so if it has no condition
+ * routine and isn't a prefix (or for a backward among, a suffix) of another
+ * entry - any such entry would have it as its longest substring or further
+ * down that chain.
+ */
+
+#define MAX_FAST_PATHS 3
+
+static int among_fast_paths(struct generator * g, struct among * x, int * fast) {
+    unsigned long * counts = x->profile;
+    if (counts == NULL || g->options->profile) return 0;
+
+    unsigned long total = 0;
+    for (int i = 0; i <= x->literalstring_count; i++) total += counts[i];
+    /* Too few lookups to go on. */
+    if (total < 100) return 0;
+
+    int n = 0;
+    while (n < MAX_FAST_PATHS) {
+        int best = -1;
+        for (int i = 0; i < x->literalstring_count; i++) {
+            struct amongvec * v = x->b + i;
+            if (v->size == 0 || v->function) continue;
+            /* Worth a call to eq_s() which usually fails? */
+            if (counts[i] * 5 < total) continue;
+            int j;
+            for (j = 0; j < n; j++) {
+                if (fast[j] == i) break;
+            }
+            if (j < n) continue;
+            for (j = 0; j < x->literalstring_count; j++) {
+                if (x->b[j].i == i) break;
+            }
+            if (j < x->literalstring_count) continue;
+            if (best < 0 || counts[i] > counts[best]) best = i;
+        }
+        if (best < 0) break;
+        fast[n++] = best;
+    }
+    return n;
+}
+
+static void write_find_among(struct generator * g, struct node * p) {
+    struct among * x = p->among;
+    int fast[MAX_FAST_PATHS];
+    int n_fast = among_fast_paths(g, x, fast);
+    int packed = among_uses_packed(g, x);
+    if (n_fast) {
+        int * offsets = NULL;
+        if (packed) {
+            offsets = (int *) MALLOC(x->literalstring_count * sizeof(int));
+            lose_b(among_pool(x, offsets));
+        }
+        unsigned long total = 0;
+        for (int i = 0; i <= x->literalstring_count; i++) total += x->profile[i];
+        write_char(g, '(');
+        for (int k = 0; k < n_fast; k++) {
+            struct amongvec * v = x->b + fast[k];
+            g->S[0] = p->mode == m_forward ? "" : "_b";
+            /* Hint when this is the usual outcome. */
+            g->S[1] = x->profile[fast[k]] * 2 >= total ? "SN_LIKELY" : "";
+            g->I[0] = x->number;
+            g->I[1] = fast[k];
+            g->I[2] = v->size;
+            g->I[3] = v->result;
+            if (packed) {
+                /* The strings are only in the pool. */
+                g->I[4] = offsets[fast[k]];
+                writef(g, "~S1(eq_s~S0~i(z, ~I2, as_~I0 + ~I4))", p);
+            } else {
+                writef(g, "~S1(eq_s~S0~i(z, ~I2, s_~I0_~I1))", p);
+            }
+            if (x->amongvar_needed) {
+                writef(g, " ? ~I3 : ", p);
+            } else {
+                /* Only whether it matched is used. */
+                writef(g, " || ", p);
+            }
+        }
+        if (offsets) FREE(offsets);
+    }
+    g->S[0] = p->mode == m_forward ? "" : "_b";
+    g->I[0] = x->number;
+    g->I[1] = x->literalstring_count;
+    if (g->options->profile) {
+        writef(g, "find_among~S0_p(z, a_~I0, ~I1, ~F, prof_a_~I0)", p);
+    } else if (among_uses_trie(g, x)) {
+        writef(g, "find_among_trie~S0(z, a_~I0, &t_~I0, ~F)", p);
+    } else if (packed) {
+        /* There's no pool if the only string is empty. */
+        writef(g, x->longest_size ?
+                  "find_among_packed~S0(z, a_~I0, as_~I0, ~I1, ~F)" :
+                  "find_among_packed~S0(z, a_~I0, 0, ~I1, ~F)", p);
+    } else {
+        writef(g, "find_among~S0(z, a_~I0, ~I1, ~F)", p);
+    }
+    if (n_fast) write_char(g, ')');
+}
+
+struct trie_node {
+    symbol ch;
+    int entry;      /* 1 + among index, or 0 */
+    int child;      /* first child (children are sorted by ch), or -1 */
+    int sibling;    /* next sibling, or -1 */
+};
+
+static void write_trie_array(struct generator * g, const char * type,
+                             const char * suffix, const int * values, int n) {
+    g->S[1] = type;
+    g->S[2] = suffix;
+    g->I[1] = n;
+    w(g, "static const ~S1 t_~I0_~S2[~I1] = {");
+    for (int i = 0; i < n; i++) {
+        if (i % 16 == 0) w(g, "~N   ");
+        write_char(g, ' ');
+        write_int(g, values[i]);
+        if (i < n - 1) write_char(g, ',');
+    }
+    w(g, "~N};~N");
+}
+
+static void generate_among_trie(struct generator * g, struct among * x) {
+    struct amongvec * v = x->b;
+    int max_nodes = among_trie_size(x);
+    int backward = (x->substring ? x->substring->mode : x->node->mode) == m_backward;
+    NEWVEC(trie_node, nodes, max_nodes);
+    int n_nodes = 1;
+
+    nodes[0].entry = 0;
+    nodes[0].child = -1;
+    nodes[0].sibling = -1;
+    for (int i = 0; i < x->literalstring_count; i++) {
+        int node = 0;
+        for (int k = 0; k < v[i].size; k++) {
+            symbol ch = v[i].b[backward ? v[i].size - 1 - k : k];
+            int * link = &nodes[node].child;
+            while (*link >= 0 && nodes[*link].ch < ch) link = &nodes[*link].sibling;
+            if (*link < 0 || nodes[*link].ch != ch) {
+                struct trie_node * t = &nodes[n_nodes];
+                t->ch = ch;
+                t->entry = 0;
+                t->child = -1;
+                t->sibling = *link;
+                *link = n_nodes++;
+            }
+            node = *link;
+        }
+        nodes[node].entry = i + 1;
+    }
+
+    /* Renumber in breadth-first order. */
+    {
+        int * order = (int *) MALLOC(n_nodes * sizeof(int));
+        int * start = (int *) MALLOC((n_nodes + 1) * sizeof(int));
+        int * chars = (int *) MALLOC(n_nodes * sizeof(int));
+        int * entry = (int *) MALLOC(n_nodes * sizeof(int));
+        int n_edges = 0;
+        int n_ordered = 1;
+        order[0] = 0;
+        for (int i = 0; i < n_nodes; i++) {
+            struct trie_node * t = &nodes[order[i]];
+            start[i] = n_edges;
+            entry[i] = t->entry;
+            for (int c = t->child; c >= 0; c = nodes[c].sibling) {
+                chars[n_edges++] = nodes[c].ch;
+                order[n_ordered++] = c;
+            }
+        }
+        start[n_nodes] = n_edges;
+
+        g->I[0] = x->number;
+        write_trie_array(g, "unsigned short", "start", start, n_nodes + 1);
+        if (n_edges) {
+            write_trie_array(g, "symbol", "ch", chars, n_edges);
+        }
+        write_trie_array(g, "unsigned short", "entry", entry, n_nodes);
+        w(g, "static const struct among_trie t_~I0 = { t_~I0_start, ");
+        w(g, n_edges ? "t_~I0_ch" : "0");
+        w(g, ", t_~I0_entry };~N");
+
+        FREE(order);
+        FREE(start);
+        FREE(chars);
+        FREE(entry);
+    }
+    FREE(nodes);
+}
+
+/* Switch-based among lookups.
+ *
+ * An among with only a few strings is matched by generated code instead of
+ * a call to find_among() or find_among_b(): a switch on the next symbol for
+ * each node of the trie of the strings, with the entry ending at each node
+ * (if any) tried after the longer strings below it.  This tries matching
+ * entries in the same order as the runtime does (longest first, then down
+ * the substring_i chain), and calls condition routines directly.
+ */
+
+#define MAX_SWITCH_AMONG 16
+
+static int among_uses_switch(struct generator * g, struct among * x) {
+    /* The profiling lookups need the table. */
+    if (g->options->profile || x->literalstring_count > MAX_SWITCH_AMONG) {
+        return 0;
+    }
+    /* If -profile-use found entries worth testing for first, the lookup
+     * with those fast paths is used instead, since the switch can't put
+     * them first. */
+    int fast[MAX_FAST_PATHS];
+    return among_fast_paths(g, x, fast) == 0;
+}
+
+/* The symbol at depth (counting in the direction of matching) of entry v. */
+static symbol among_switch_ch(struct node * p, struct amongvec * v, int depth) {
+    return p->mode == m_forward ? v->b[depth] : v->b[v->size - 1 - depth];
+}
+
+/* Generate the code for the trie node at depth, which the n entries in ix
+ * all pass through.  ~B0 is the saved cursor and ~B1 the result. */
+static void generate_among_switch_node(struct generator * g, struct node * p,
+                                       int * ix, int n, int depth) {
+    struct amongvec * v = p->among->b;
+    struct amongvec * entry = NULL;
+    int m = 0;
+
+    /* Remove the entry ending here (if any) and sort the rest by their next
+     * symbol so each child's entries are together. */
+    for (int i = 0; i < n; i++) {
+        if (v[ix[i]].size == depth) {
+            entry = v + ix[i];
+            continue;
+        }
+        int k = m++;
+        int e = ix[i];
+        symbol ch = among_switch_ch(p, v + e, depth);
+        while (k > 0 && among_switch_ch(p, v + ix[k - 1], depth) > ch) {
+            ix[k] = ix[k - 1];
+            k--;
+        }
+        ix[k] = e;
+    }
+
+    if (m) {
+        g->I[0] = depth;
+        if (p->mode == m_forward) {
+            writef(g, depth ? "~Mif (~B0 + ~I0 < z->l) " : "~Mif (~B0 < z->l) ", p);
+            writef(g, depth ? "switch (z->p[~B0 + ~I0]) {~N~+" : "switch (z->p[~B0]) {~N~+", p);
+        } else {
+            writef(g, depth ? "~Mif (~B0 - ~I0 > z->lb) " : "~Mif (~B0 > z->lb) ", p);
+            g->I[1] = depth + 1;
+            writef(g, "switch (z->p[~B0 - ~I1]) {~N~+", p);
+        }
+        for (int i = 0; i < m; ) {
+            symbol ch = among_switch_ch(p, v + ix[i], depth);
+            int j = i + 1;
+            while (j < m && among_switch_ch(p, v + ix[j], depth) == ch) j++;
+            g->I[0] = ch;
+            writef(g, "~Mcase ~c0:~N~+", p);
+            generate_among_switch_node(g, p, ix + i, j - i, depth + 1);
+            w(g, "~Mbreak;~N~-");
+            i = j;
+        }
+        w(g, "~}");
+    }
+
+    if (entry) {
+        /* If there were longer strings, one may already have matched. */
+        if (m) {
+            writef(g, "~Mif (!~B1) {~N~+", p);
+        }
+        g->I[0] = depth;
+        g->I[1] = entry->result;
+        g->S[0] = p->mode == m_forward ? "+" : "-";
+        writef(g, depth ? "~Mz->c = ~B0 ~S0 ~I0;~N" : "~Mz->c = ~B0;~N", p);
+        if (entry->function) {
+            write_margin(g);
+            w(g, "if (");
+            write_varref(g, entry->function);
+            w(g, "(z)) {~N~+");
+            writef(g, depth ? "~Mz->c = ~B0 ~S0 ~I0;~N" : "~Mz->c = ~B0;~N", p);
+            writef(g, "~M~B1 = ~I1;~N", p);
+            w(g, "~}");
+        } else {
+            writef(g, "~M~B1 = ~I1;~N", p);
+        }
+        if (m) w(g, "~}");
+    }
+}
+
+/* Generate a switch-based lookup for p's among, leaving the result (or 0 if
+ * no entry matched) in among_var, or testing it directly if that isn't
+ * needed. */
+static void generate_among_switch(struct generator * g, struct node * p) {
+    struct among * x = p->among;
+    struct str * cursor = vars_newname(g);
+    struct str * result;
+    if (x->amongvar_needed) {
+        result = str_new();
+        str_append_string(result, "among_var");
+    } else {
+        result = vars_newname(g);
+    }
+    int * ix = (int *) MALLOC(x->literalstring_count * sizeof(int));
+
+    for (int i = 0; i < x->literalstring_count; i++) ix[i] = i;
+
+    g->B[0] = str_data(cursor);
+    g->B[1] = str_data(result);
+    writef(g, "~{~Mint ~B0 = z->c;~N", p);
+    writef(g, x->amongvar_needed ? "~M~B1 = 0;~N" : "~Mint ~B1 = 0;~N", p);
+    generate_among_switch_node(g, p, ix, x->literalstring_count, 0);
+    FREE(ix);
+
+    g->B[1] = str_data(result);
+    if (!x->always_matches) writef(g, "~Mif (!~B1) ~f~N", p);
+    w(g, "~}");
+
+    str_delete(cursor);
+    str_delete(result);
+    /* The table isn't needed. */
+    x->used = false;
+}
+
 static void generate_substring(struct generator * g, struct node * p) {
     write_comment(g, p);
 
     struct among * x = p->among;
+
+    /* Handled well by the code below. */
+    int single_symbols = !x->amongvar_needed && !x->function_count &&
+                         x->longest_size == 1 && !x->always_matches;
+    if (among_uses_switch(g, x) && !single_symbols) {
+        generate_among_switch(g, p);
+        return;
+    }
     int block = -1;
     unsigned int bitmap = 0;
     struct amongvec * among_cases = x->b;
@@ -1486,7 +2002,7 @@ static void generate_substring(struct generator * g, struct node * p) {
     }
 
     if (x->amongvar_needed) {
-        writef(g, "~Mamong_var = find_among~S0(z, a_~I0, ~I1, ~F);~N", p);
+        writef(g, "~Mamong_var = ~A;~N", p);
         if (!x->always_matches) {
             writef(g, "~Mif (!among_var) ~f~N", p);
         }
@@ -1508,14 +2024,16 @@ static void generate_substring(struct generator * g, struct node * p) {
     }
 
     if (x->always_matches) {
-        writef(g, "~Mfind_among~S0(z, a_~I0, ~I1, ~F);~N", p);
+        /* With -profile-use this may be an expression using ||, so cast
+         * to void to avoid a warning. */
+        writef(g, x->profile ? "~M(void)~A;~N" : "~M~A;~N", p);
     } else if (x->command_count == 0 &&
                g->failure_label == x_return &&
                x->node->right && x->node->right->type == c_functionend) {
-        writef(g, "~Mreturn find_among~S0(z, a_~I0, ~I1, ~F) != 0;~N", p);
+        writef(g, "~Mreturn ~A != 0;~N", p);
         x->node->right = NULL;
     } else {
-        writef(g, "~Mif (!find_among~S0(z, a_~I0, ~I1, ~F)) ~f~N", p);
+        writef(g, "~Mif (!~A) ~f~N", p);
     }
 }
 
@@ -1685,14 +2203,21 @@ void write_start_comment(struct generator * g,
     w(g, "~N~N");
 }
 
-static void generate_head(struct generator * g) {
+static void write_runtime_include(struct generator * g, const char * file) {
     w(g, "#include \"");
     if (g->options->runtime_path) {
         write_string(g, g->options->runtime_path);
         if (g->options->runtime_path[strlen(g->options->runtime_path) - 1] != '/')
             write_char(g, '/');
     }
-    w(g, "header.h\"~N~N");
+    write_string(g, file);
+    w(g, "\"~N~N");
+}
+
+static void generate_head(struct generator * g) {
+    write_runtime_include(g, "header.h");
+    if (g->options->profile) w(g, "#include <stdio.h>~N~N");
+    if (g->options->struct_env) w(g, "#include <stdlib.h>~N~N");
 }
 
 static void generate_routine_headers(struct generator * g) {
@@ -1720,10 +2245,59 @@ static void generate_routine_headers(struct generator * g) {
     }
 }
 
+static void generate_among_dispatcher(struct generator * g, struct among * x);
+
+static void generate_among_table_packed(struct generator * g, struct among * x) {
+    struct amongvec * v = x->b;
+    int * offsets = (int *) MALLOC(x->literalstring_count * sizeof(int));
+    symbol * pool = among_pool(x, offsets);
+
+    g->I[0] = x->number;
+    if (SIZE(pool)) {
+        g->I[1] = SIZE(pool);
+        w(g, "static const symbol as_~I0[~I1] = {");
+        for (int i = 0; i < SIZE(pool); i++) {
+            if (i % 16 == 0) w(g, "~N   ");
+            write_char(g, ' ');
+            wlitch(g, pool[i]);
+            if (i < SIZE(pool) - 1) write_char(g, ',');
+        }
+        w(g, "~N};~N");
+    }
+
+    g->I[1] = x->literalstring_count;
+    w(g, "~Mstatic const struct among_packed a_~I0[~I1] = {~N");
+
+    for (int i = 0; i < x->literalstring_count; i++) {
+        if (i) w(g, ",~N");
+        g->I[1] = i;
+        g->I[2] = offsets[i];
+        g->I[3] = v[i].size;
+        g->I[4] = v[i].function_index;
+        g->I[5] = (v[i].i >= 0 ? v[i].i + 1 : 0);
+        g->I[6] = v[i].result;
+
+        if (g->options->comments) {
+            w(g, "/*~J1 */ ");
+        }
+        w(g, "{ ~I2, ~I3, ~I4, ~I5, ~I6 }");
+    }
+    w(g, "~N};~N");
+
+    lose_b(pool);
+    FREE(offsets);
+}
+
 static void generate_among_table(struct generator * g, struct among * x) {
     write_newline(g);
     write_comment(g, x->node);
 
+    if (among_uses_packed(g, x)) {
+        generate_among_table_packed(g, x);
+        generate_among_dispatcher(g, x);
+        return;
+    }
+
     struct amongvec * v = x->b;
 
     g->I[0] = x->number;
@@ -1761,9 +2335,22 @@ static void generate_among_table(struct generator * g, struct among * x) {
     }
     w(g, "~N};~N");
 
+    if (among_uses_trie(g, x)) {
+        write_newline(g);
+        generate_among_trie(g, x);
+    }
+
+    generate_among_dispatcher(g, x);
+}
+
+static void generate_among_dispatcher(struct generator * g, struct among * x) {
+    struct amongvec * v = x->b;
+
     if (x->function_count <= 1) return;
 
-    w(g, "~N~Mstatic int af_~I0(struct SN_env * z) {~N~+");
+    g->I[0] = x->number;
+    g->S[0] = g->ascii_variant ? "afa_" : "af_";
+    w(g, "~N~Mstatic int ~S0~I0(struct SN_env * z) {~N~+");
     w(g, "~Mswitch (z->af) {~N~+");
     for (int n = 1; n <= x->function_count; n++) {
         w(g, "~Mcase ");
@@ -1793,7 +2380,42 @@ static void generate_amongs(struct generator * g) {
 
 static void set_bit(symbol * b, int i) { b[i/8] |= 1 << i%8; }
 
+/* Write a table with one entry per byte value (or per ASCII character for
+ * UTF-8), which is 1 for characters in the grouping.  This lets the runtime
+ * test membership with a single load.
+ */
+static void generate_grouping_lookup(struct generator * g, struct grouping * q) {
+    int size = g->options->encoding == ENC_UTF8 ? 128 : 256;
+    symbol * b = q->b;
+    byte lookup[256];
+
+    for (int i = 0; i < size; i++) lookup[i] = 0;
+    for (int i = 0; i < SIZE(b); i++) {
+        if (b[i] < size) lookup[b[i]] = 1;
+    }
+
+    w(g, "~Nstatic const unsigned char gt_");
+    write_s(g, q->name->s);
+    w(g, "[");
+    write_int(g, size);
+    w(g, "] = {~N");
+    for (int i = 0; i < size; i++) {
+        if (i % 32 == 0) {
+            if (i) w(g, ",~N");
+            w(g, "    ");
+        } else {
+            w(g, ", ");
+        }
+        write_int(g, lookup[i]);
+    }
+    w(g, "~N};~N");
+}
+
 static void generate_grouping_table(struct generator * g, struct grouping * q) {
+    generate_grouping_lookup(g, q);
+    /* The bitmap is only needed for non-ASCII characters in UTF-8. */
+    if (g->options->encoding != ENC_UTF8) return;
+
     int range = q->largest_ch - q->smallest_ch + 1;
     int size = (range + 7)/ 8;  /* assume 8 bits per symbol */
     symbol * b = q->b;
@@ -1825,6 +2447,79 @@ static void generate_groupings(struct generator * g) {
     g->outbuf = s;
 }
 
+/* With -struct-env the variables are named fields of a struct which starts
+ * with the SN_env and also holds the initial buffers for the strings, so it
+ * can be set up without allocating any memory.
+ */
+static void generate_env_struct(struct generator * g) {
+    static const byte types[] = { t_integer, t_boolean, t_string };
+    struct name * q;
+
+    w(g, "struct ~penv {~N~+"
+         "~Mstruct SN_env z;~N");
+    for (int i = 0; i < 3; i++) {
+        for (q = g->analyser->names; q; q = q->next) {
+            if (q->type != types[i]) continue;
+            write_margin(g);
+            switch (q->type) {
+                case t_integer: w(g, "int "); break;
+                case t_boolean: w(g, "unsigned char "); break;
+                default: w(g, "symbol * "); break;
+            }
+            write_varname(g, q);
+            w(g, ";~N");
+        }
+    }
+    w(g, "~Mint buf_p[SN_BUFFER_INTS(SN_WORD_CAPACITY)];~N");
+    for (q = g->analyser->names; q; q = q->next) {
+        if (q->type != t_string) continue;
+        w(g, "~Mint buf_");
+        write_varname(g, q);
+        w(g, "[SN_BUFFER_INTS(SN_STRING_CAPACITY)];~N");
+    }
+    w(g, "~-};~N~N");
+}
+
+static void generate_struct_env_functions(struct generator * g) {
+    struct name * q;
+
+    w(g, "~Nextern void ~pinit_env(struct ~penv * env) {~N~+"
+         "~Mmemset(env, 0, sizeof(*env));~N"
+         "~Menv->z.p = SN_init_s(env->buf_p, SN_WORD_CAPACITY);~N");
+    for (q = g->analyser->names; q; q = q->next) {
+        if (q->type != t_string) continue;
+        w(g, "~Menv->");
+        write_varname(g, q);
+        w(g, " = SN_init_s(env->buf_");
+        write_varname(g, q);
+        w(g, ", SN_STRING_CAPACITY);~N");
+    }
+    w(g, "~-}~N");
+
+    w(g, "~Nextern void ~pfree_env(struct ~penv * env) {~N~+");
+    for (q = g->analyser->names; q; q = q->next) {
+        if (q->type != t_string) continue;
+        w(g, "~Mlose_s(env->");
+        write_varname(g, q);
+        w(g, ");~N");
+    }
+    w(g, "~Mlose_s(env->z.p);~N"
+         "~-}~N");
+
+    w(g, "~Nextern struct SN_env * ~pcreate_env(void) {~N~+"
+         "~Mstruct ~penv * env = (struct ~penv *) malloc(sizeof(struct ~penv));~N"
+         "~Mif (env == NULL) return NULL;~N"
+         "~M~pinit_env(env);~N"
+         "~Mreturn &env->z;~N"
+         "~-}~N");
+
+    w(g, "~Nextern void ~pclose_env(struct SN_env * z) {~N~+"
+         "~Mif (z == NULL) return;~N"
+         "~M~pfree_env((struct ~penv *) z);~N"
+         "~Mfree(z);~N"
+         "~-}~N~N");
+}
+
 static void generate_create(struct generator * g) {
     int * p = g->analyser->name_count;
     g->I[0] = p[t_string];
@@ -1840,17 +2535,151 @@ static void generate_close(struct generator * g) {
     w(g, "~Nextern void ~pclose_env(struct SN_env * z) { SN_close_env(z, ~I0); }~N~N");
 }
 
+static void generate_max_length(struct generator * g) {
+    int ratio = g->analyser->max_length_ratio;
+    int extra = g->analyser->max_length_extra;
+    w(g, "~Nextern int ~pmax_length(int size) {~N~+");
+    if (ratio < 0) {
+        w(g, "~M(void)size;~N"
+             "~Mreturn -1;~N");
+    } else if (ratio == 0) {
+        g->I[0] = extra;
+        w(g, "~M(void)size;~N"
+             "~Mreturn ~I0;~N");
+    } else {
+        g->I[0] = ratio;
+        g->I[1] = extra;
+        g->I[2] = (INT_MAX - extra) / ratio;
+        w(g, "~Mif (size > ~I2) return -1;~N"
+             "~Mreturn size");
+        if (ratio > 1) w(g, " * ~I0");
+        if (extra > 0) w(g, " + ~I1");
+        w(g, ";~N");
+    }
+    w(g, "~-}~N");
+}
+
+/* Counters for -profile.  Each among has one per entry, plus one for
+ * lookups which don't match.
+ */
+static void generate_profile_counters(struct generator * g) {
+    int * name_count = g->analyser->name_count;
+    struct str * s = g->outbuf;
+    g->outbuf = g->declarations;
+
+    g->I[0] = name_count[t_routine] + name_count[t_external];
+    if (g->I[0]) {
+        w(g, "~Nstatic unsigned long prof_r[~I0];~N");
+        w(g, "static const char * const prof_r_names[~I0] = {~N");
+        for (int type = t_routine; type <= t_external; type++) {
+            for (struct name * q = g->analyser->names; q; q = q->next) {
+                if (q->type != type) continue;
+                w(g, "    \"");
+                write_s(g, q->s);
+                w(g, "\",~N");
+            }
+        }
+        w(g, "};~N");
+    }
+
+    g->I[0] = name_count[t_grouping];
+    if (g->I[0]) {
+        w(g, "~Nstatic unsigned long prof_g[~I0];~N");
+        w(g, "static const char * const prof_g_names[~I0] = {~N");
+        for (struct name * q = g->analyser->names; q; q = q->next) {
+            if (q->type != t_grouping) continue;
+            w(g, "    \"");
+            write_s(g, q->s);
+            w(g, "\",~N");
+        }
+        w(g, "};~N");
+    }
+
+    write_newline(g);
+    for (struct among * x = g->analyser->amongs; x; x = x->next) {
+        if (!x->used) continue;
+        g->I[0] = x->number;
+        g->I[1] = x->literalstring_count + 1;
+        w(g, "static unsigned long prof_a_~I0[~I1];~N");
+    }
+    g->outbuf = s;
+}
+
+/* Write the counts collected with -profile to stderr, one per line:
+ *
+ *   routine NAME COUNT
+ *   grouping NAME COUNT
+ *   among NUMBER INDEX COUNT STRING
+ *   among NUMBER - COUNT
+ *
+ * The last form is the number of lookups which matched no entry.
+ */
+static void generate_dump_profile(struct generator * g) {
+    int * name_count = g->analyser->name_count;
+    if (g->analyser->amongs) {
+        w(g, "~Nstatic void prof_dump_among(int n, int line, const struct among * v, int v_size, const unsigned long * counts) {~N~+"
+             "~Mint i;~N"
+             "~Mfprintf(stderr, \"# among %d at line %d\\n\", n, line);~N"
+             "~Mfor (i = 0; i < v_size; i++) {~N~+"
+             "~Mfprintf(stderr, \"among %d %d %lu \", n, i, counts[i]);~N"
+             "~Mif (v[i].s_size) fwrite(v[i].s, sizeof(symbol), v[i].s_size, stderr);~N"
+             "~Mfputc('\\n', stderr);~N"
+             "~-~M}~N"
+             "~Mfprintf(stderr, \"among %d - %lu\\n\", n, counts[v_size]);~N"
+             "~-}~N");
+    }
+    w(g, "~Nextern void ~pdump_profile(void) {~N~+");
+    if (name_count[t_routine] + name_count[t_external] + name_count[t_grouping]) {
+        w(g, "~Mint i;~N");
+    }
+    g->I[0] = name_count[t_routine] + name_count[t_external];
+    if (g->I[0]) {
+        w(g, "~Mfor (i = 0; i < ~I0; i++) {~N~+"
+             "~Mfprintf(stderr, \"routine %s %lu\\n\", prof_r_names[i], prof_r[i]);~N"
+             "~-~M}~N");
+    }
+    g->I[0] = name_count[t_grouping];
+    if (g->I[0]) {
+        w(g, "~Mfor (i = 0; i < ~I0; i++) {~N~+"
+             "~Mfprintf(stderr, \"grouping %s %lu\\n\", prof_g_names[i], prof_g[i]);~N"
+             "~-~M}~N");
+    }
+    for (struct among * x = g->analyser->amongs; x; x = x->next) {
+        if (!x->used) continue;
+        g->I[0] = x->number;
+        g->I[1] = x->node->line_number;
+        g->I[2] = x->literalstring_count;
+        w(g, "~Mprof_dump_among(~I0, ~I1, a_~I0, ~I2, prof_a_~I0);~N");
+    }
+    w(g, "~-}~N");
+}
+
 static void generate_create_and_close_templates(struct generator * g) {
     w(g, "~N"
          "extern struct SN_env * ~pcreate_env(void);~N"
          "extern void ~pclose_env(struct SN_env * z);~N"
+         "~N"
+         "/* The longest the string can get while stemming a word of size~N"
+         " * symbols, or -1 if there's no bound. */~N"
+         "extern int ~pmax_length(int size);~N"
          "~N");
+    if (g->options->struct_env) {
+        generate_env_struct(g);
+        w(g, "extern void ~pinit_env(struct ~penv * env);~N"
+             "extern void ~pfree_env(struct ~penv * env);~N~N");
+    }
+    if (g->options->profile) {
+        w(g, "extern void ~pdump_profile(void);~N~N");
+    }
 }
 
-static void generate_header_file(struct generator * g) {
+static void generate_header_file(struct generator * g, int ascii) {
     const char * vp = g->options->variables_prefix;
     g->S[0] = vp;
 
+    /* The state struct contains a struct SN_env. */
+    if (g->options->struct_env) write_runtime_include(g, "api.h");
+
     w(g, "#ifdef __cplusplus~N"
          "extern \"C\" {~N"
          "#endif~N");            /* for C++ */
@@ -1862,6 +2691,24 @@ static void generate_header_file(struct generator * g) {
                 w(g, "extern int ");
                 write_varname(g, q);
                 w(g, "(struct SN_env * z);~N");
+                if (g->options->encoding != ENC_UTF8) break;
+                if (ascii) {
+                    /* Only valid when the input is entirely ASCII. */
+                    g->ascii_variant = true;
+                    w(g, "extern int ");
+                    write_varname(g, q);
+                    w(g, "(struct SN_env * z);~N");
+                    g->ascii_variant = false;
+                } else {
+                    /* No separate variant for ASCII input. */
+                    w(g, "#define ");
+                    g->ascii_variant = true;
+                    write_varname(g, q);
+                    g->ascii_variant = false;
+                    w(g, " ");
+                    write_varname(g, q);
+                    w(g, "~N");
+                }
                 break;
             case t_string:
             case t_integer:
@@ -1875,6 +2722,14 @@ static void generate_header_file(struct generator * g) {
                                 q->s);
                         exit(1);
                     }
+                    if (g->options->struct_env) {
+                        w(g, "#define ~S0");
+                        write_s(g, q->s);
+                        w(g, " ");
+                        write_varname(g, q);
+                        w(g, "~N");
+                        break;
+                    }
                     if (q->type == t_boolean) {
                         /* We use a single array for booleans and integers,
                          * with the integers first.
@@ -1900,7 +2755,108 @@ static void generate_header_file(struct generator * g) {
     w(g, "~N");
 }
 
+/* For ASCII input, a UTF-8 stemmer gives the same results if every
+ * character is handled as a single byte, so we can generate a second copy of
+ * the code which avoids decoding UTF-8.  That stops being true once
+ * non-ASCII text is inserted, so only do this when no literal string which
+ * can be inserted contains any.  String variables can only get their
+ * contents from the word being stemmed or from such literals.
+ */
+static int ascii_variant_possible(struct analyser * a) {
+    for (struct node * p = a->nodes; p; p = p->next) {
+        switch (p->type) {
+            case c_assign:
+            case c_attach:
+            case c_insert:
+            case c_slicefrom:
+                if (p->literalstring) {
+                    symbol * b = p->literalstring;
+                    for (int i = 0; i < SIZE(b); i++) {
+                        if (b[i] >= 0x80) return false;
+                    }
+                }
+                break;
+        }
+    }
+    return true;
+}
+
+/* Generating code drops some c_functionend nodes from the tree when it
+ * writes a tail return, so the links have to be saved and restored to
+ * generate the same code twice.
+ */
+static struct node ** save_node_links(struct analyser * a) {
+    int n = 0;
+    for (struct node * p = a->nodes; p; p = p->next) n++;
+    struct node ** links = (struct node **)MALLOC(sizeof(struct node *) * (n + 1));
+    n = 0;
+    for (struct node * p = a->nodes; p; p = p->next) links[n++] = p->right;
+    return links;
+}
+
+static void restore_node_links(struct analyser * a, struct node ** links) {
+    int n = 0;
+    for (struct node * p = a->nodes; p; p = p->next) p->right = links[n++];
+    FREE(links);
+}
+
+static void generate_ascii_variant(struct generator * g) {
+    g->ascii_variant = true;
+    g->options->encoding = ENC_SINGLEBYTE;
+    g->literalstring_count = 0;
+
+    for (struct node * p = g->analyser->program; p; p = p->right) {
+        generate(g, p);
+    }
+
+    struct str * s = g->outbuf;
+    g->outbuf = g->declarations;
+    for (struct among * x = g->analyser->amongs; x; x = x->next) {
+        if (x->used) generate_among_dispatcher(g, x);
+    }
+    g->outbuf = s;
+
+    g->options->encoding = ENC_UTF8;
+    g->ascii_variant = false;
+}
+
+static int count_lines(const struct str * s, int len) {
+    const byte * p = str_data(s);
+    int n = 0;
+    for (int i = 0; i < len; i++) {
+        if (p[i] == '\n') n++;
+    }
+    return n;
+}
+
+/* Output the routines, then a #line directive pointing back into the
+ * generated file for the code after them which isn't from the Snowball
+ * source. */
+static void output_line_reset(struct generator * g, int routines_end) {
+    FILE * f = g->options->output_src;
+    const byte * p = str_data(g->outbuf);
+    int len = str_len(g->outbuf);
+    /* +1 for the directive's own line, and +1 since it gives the number of
+     * the line after it. */
+    int line = count_lines(g->declarations, str_len(g->declarations)) +
+               count_lines(g->outbuf, routines_end) + 2;
+    struct str * s = g->outbuf;
+    fwrite(p, 1, routines_end, f);
+    g->outbuf = str_new();
+    write_line_directive(g, line, g->options->output_file,
+                         g->options->make_lang == LANG_CPLUSPLUS ? ".cc" : ".c");
+    output_str(f, g->outbuf);
+    str_delete(g->outbuf);
+    g->outbuf = s;
+    fwrite(p + routines_end, 1, len - routines_end, f);
+}
+
 extern void generate_program_c(struct generator * g) {
+    int ascii = g->options->ascii_variant &&
+                g->options->encoding == ENC_UTF8 &&
+                ascii_variant_possible(g->analyser);
+    struct node ** links = ascii ? save_node_links(g->analyser) : NULL;
+
     g->outbuf = str_new();
     g->failure_str = str_new();
     write_start_comment(g, "/* ", " */");
@@ -1909,6 +2865,11 @@ extern void generate_program_c(struct generator * g) {
     }
     generate_head(g);
     generate_routine_headers(g);
+    if (ascii) {
+        g->ascii_variant = true;
+        generate_routine_headers(g);
+        g->ascii_variant = false;
+    }
     w(g, "#ifdef __cplusplus~N"
          "extern \"C\" {~N"
          "#endif~N"
@@ -1925,20 +2886,40 @@ extern void generate_program_c(struct generator * g) {
     for (struct node * p = g->analyser->program; p; p = p->right) {
         generate(g, p);
     }
+    if (ascii) {
+        restore_node_links(g->analyser, links);
+        generate_ascii_variant(g);
+    }
+
+    /* Everything in outbuf up to here is from the Snowball source. */
+    int routines_end = str_len(g->outbuf);
 
     generate_amongs(g);
     generate_groupings(g);
 
-    generate_create(g);
-    generate_close(g);
+    if (g->options->struct_env) {
+        generate_struct_env_functions(g);
+    } else {
+        generate_create(g);
+        generate_close(g);
+    }
+    generate_max_length(g);
+    if (g->options->profile) {
+        generate_profile_counters(g);
+        generate_dump_profile(g);
+    }
 
     output_str(g->options->output_src, g->declarations);
+    if (g->options->line_directives) {
+        output_line_reset(g, routines_end);
+    } else {
+        output_str(g->options->output_src, g->outbuf);
+    }
     str_delete(g->declarations);
-    output_str(g->options->output_src, g->outbuf);
     str_clear(g->outbuf);
 
     write_start_comment(g, "/* ", " */");
-    generate_header_file(g);
+    generate_header_file(g, ascii);
     output_str(g->options->output_h, g->outbuf);
     str_delete(g->outbuf);
     str_delete(g->failure_str);
@@ -1957,6 +2938,7 @@ extern struct generator * create_generator(struct analyser * a, struct options *
     g->line_labelled = 0;
     g->failure_label = -1;
     g->unreachable = false;
+    g->ascii_variant = false;
 #ifndef DISABLE_PYTHON
     g->max_label = 0;
 #endif
@@ -257,6 +257,8 @@ struct among {
     struct node * substring;  /* i.e. substring ... among ( ... ) */
     struct node ** commands;  /* array with command_count entries */
     struct node * node;       /* pointer to the node for this among */
+    unsigned long * profile;  /* hits per entry then misses (from
+                                 -profile-use), or NULL */
 };
 
 struct grouping {
@@ -291,6 +293,7 @@ struct node {
     symbol * literalstring;
     int number;
     int line_number;
+    const char * file;     /* source file, for -line-directives */
 };
 
 enum name_types {
@@ -332,6 +335,11 @@ struct analyser {
     struct name * current_routine; /* routine/external we're currently on. */
     enc encoding;
     byte int_limits_used;     /* are maxint or minint used? */
+    /* The longest the string being stemmed can get is
+     * max_length_ratio * n + max_length_extra symbols for an input of n
+     * symbols, or max_length_ratio is -1 if we couldn't bound it. */
+    int max_length_ratio;
+    int max_length_extra;
 };
 
 enum analyser_modes {
@@ -380,6 +388,8 @@ struct generator {
     int keep_count;      /* used to number keep/restore pairs to avoid compiler warnings
                             about shadowed variables */
     int temporary_used;  /* track if temporary variable used (Ada and Pascal) */
+    int ascii_variant;   /* generating the byte-oriented variant of a UTF-8
+                            stemmer for ASCII input (C and C++) */
 };
 
 /* Special values for failure_label in struct generator. */
@@ -395,6 +405,14 @@ struct options {
     FILE * output_h;
     byte syntax_tree;
     byte comments;
+    byte line_directives;
+    byte inline_tests;
+    byte struct_env;
+    byte among_trie;
+    byte among_packed;
+    byte ascii_variant;
+    byte profile;
+    const char * profile_use;
     enc encoding;
     enum { LANG_JAVA, LANG_C, LANG_CPLUSPLUS, LANG_CSHARP, LANG_PASCAL, LANG_PHP, LANG_PYTHON, LANG_JAVASCRIPT, LANG_RUST, LANG_GO, LANG_ADA } make_lang;
     const char * externals_prefix;
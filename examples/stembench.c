@@ -0,0 +1,408 @@
+/* This is a simple program which uses libstemmer to measure how fast a
+ * stemming algorithm runs on a list of words.
+ *
+ * The word list is read into memory once, so the timings don't include any
+ * I/O.
+ */
+
+#include <stdio.h>
+#include <stdlib.h> /* for malloc, free, qsort */
+#include <string.h> /* for memchr, memmove */
+#include <time.h>
+
+#if defined __unix__ || defined __unix || (defined __APPLE__ && defined __MACH__)
+# include <unistd.h>
+# if defined _POSIX_TIMERS && _POSIX_TIMERS > 0 && defined CLOCK_MONOTONIC
+#  define HAVE_CLOCK_GETTIME 1
+# endif
+#endif
+
+#include "libstemmer.h"
+
+const char * progname;
+
+/* The fields output by -f csv and -f json. */
+#define CSV_HEADER "algorithm,encoding,words,bytes,passes,seconds," \
+                   "words_per_sec,mb_per_sec,ns_per_word,p50_ns,p99_ns,max_ns"
+
+/* Maximum number of words timed individually for the latency figures. */
+#define MAX_SAMPLES (1 << 20)
+
+/* Output formats for the results. */
+enum format { FORMAT_TEXT, FORMAT_CSV, FORMAT_JSON };
+
+struct word_list {
+    /* All the words, one after another, forced to lower case. */
+    sb_symbol * text;
+    /* Word i starts at text + start[i] and is start[i + 1] - start[i] bytes
+     * long. */
+    size_t * start;
+    size_t count;
+};
+
+static void
+out_of_memory(void)
+{
+    fprintf(stderr, "Out of memory or internal error\n");
+    exit(1);
+}
+
+/* Return the time in nanoseconds from some arbitrary starting point. */
+static double
+now_ns(void)
+{
+#ifdef HAVE_CLOCK_GETTIME
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+#else
+    /* Fallback - this has poor resolution, so the latency figures won't be
+     * useful, but the throughput figures should still be reasonable. */
+    return clock() * (1e9 / CLOCKS_PER_SEC);
+#endif
+}
+
+static void
+read_words(FILE * f_in, struct word_list * words)
+{
+    size_t size = 1 << 16;
+    size_t len = 0;
+    size_t n_lines = 0;
+    size_t pos, i;
+    sb_symbol * text = (sb_symbol *) malloc(size);
+    if (text == NULL) out_of_memory();
+
+    while (1) {
+        size_t got;
+        if (len == size) {
+            sb_symbol * new_text;
+            size *= 2;
+            new_text = (sb_symbol *) realloc(text, size);
+            if (new_text == NULL) out_of_memory();
+            text = new_text;
+        }
+        got = fread(text + len, 1, size - len, f_in);
+        if (got == 0) break;
+        len += got;
+    }
+    if (ferror(f_in)) {
+        fprintf(stderr, "Error reading input\n");
+        exit(1);
+    }
+
+    for (i = 0; i < len; i++) {
+        int ch = text[i];
+        if (ch == '\n') {
+            ++n_lines;
+        } else if (ch >= 'A' && ch <= 'Z') {
+            /* force lower case, as stemwords does: */
+            text[i] = ch + ('a' - 'A');
+        }
+    }
+    if (len > 0 && text[len - 1] != '\n') ++n_lines;
+
+    words->start = (size_t *) malloc((n_lines + 1) * sizeof(size_t));
+    if (words->start == NULL) out_of_memory();
+
+    /* Pack the words together, dropping the newlines. */
+    words->count = 0;
+    pos = 0;
+    i = 0;
+    while (i < len) {
+        const sb_symbol * nl = (const sb_symbol *) memchr(text + i, '\n', len - i);
+        size_t end = nl ? (size_t)(nl - text) : len;
+        words->start[words->count++] = pos;
+        memmove(text + pos, text + i, end - i);
+        pos += end - i;
+        i = end + 1;
+    }
+    words->start[words->count] = pos;
+    words->text = text;
+}
+
+/* Stem every word once. */
+static void
+stem_all(struct sb_stemmer * stemmer, const struct word_list * words)
+{
+    size_t i;
+    for (i = 0; i < words->count; i++) {
+        size_t s = words->start[i];
+        int len = (int)(words->start[i + 1] - s);
+        if (sb_stemmer_stem(stemmer, words->text + s, len) == NULL) {
+            out_of_memory();
+        }
+    }
+}
+
+static int
+compare_doubles(const void * a, const void * b)
+{
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+/* Estimate the cost of reading the clock, so it can be subtracted from the
+ * time measured for each word. */
+static double
+clock_overhead(void)
+{
+    double best = -1;
+    int i;
+    for (i = 0; i < 1000; i++) {
+        double t0 = now_ns();
+        double t1 = now_ns();
+        if (best < 0 || t1 - t0 < best) best = t1 - t0;
+    }
+    return best;
+}
+
+/* Time up to MAX_SAMPLES words individually and sort the times. */
+static size_t
+time_words(struct sb_stemmer * stemmer, const struct word_list * words,
+           double * samples)
+{
+    size_t n = words->count < MAX_SAMPLES ? words->count : MAX_SAMPLES;
+    double overhead = clock_overhead();
+    size_t i;
+    for (i = 0; i < n; i++) {
+        size_t s = words->start[i];
+        int len = (int)(words->start[i + 1] - s);
+        double t0 = now_ns();
+        double t;
+        if (sb_stemmer_stem(stemmer, words->text + s, len) == NULL) {
+            out_of_memory();
+        }
+        t = now_ns() - t0 - overhead;
+        samples[i] = t < 0 ? 0 : t;
+    }
+    qsort(samples, n, sizeof(double), compare_doubles);
+    return n;
+}
+
+static double
+percentile(const double * samples, size_t n, double p)
+{
+    size_t i = (size_t)(p * (n - 1) + 0.5);
+    return samples[i];
+}
+
+static void
+report(enum format format, const char * language, const char * charenc,
+       const struct word_list * words, long passes, double elapsed,
+       const double * samples, size_t n_samples)
+{
+    double n_words = (double)words->count * passes;
+    double n_bytes = (double)words->start[words->count] * passes;
+    double words_per_sec = n_words / elapsed * 1e9;
+    double mb_per_sec = n_bytes / elapsed * 1e3;
+    double ns_per_word = elapsed / n_words;
+    double p50 = percentile(samples, n_samples, 0.50);
+    double p99 = percentile(samples, n_samples, 0.99);
+    double max = samples[n_samples - 1];
+
+    switch (format) {
+        case FORMAT_TEXT:
+            printf("algorithm:  %s (%s)\n", language, charenc);
+            printf("words:      %lu (%lu bytes) x %ld passes\n",
+                   (unsigned long)words->count,
+                   (unsigned long)words->start[words->count], passes);
+            printf("time:       %.3f s\n", elapsed * 1e-9);
+            printf("words/sec:  %.0f\n", words_per_sec);
+            printf("MB/sec:     %.2f\n", mb_per_sec);
+            printf("ns/word:    %.1f\n", ns_per_word);
+            printf("latency:    p50 %.0f ns, p99 %.0f ns, max %.0f ns\n",
+                   p50, p99, max);
+            break;
+        case FORMAT_CSV:
+            printf("%s,%s,%lu,%lu,%ld,%.3f,%.0f,%.2f,%.1f,%.0f,%.0f,%.0f\n",
+                   language, charenc,
+                   (unsigned long)words->count,
+                   (unsigned long)words->start[words->count], passes,
+                   elapsed * 1e-9, words_per_sec, mb_per_sec, ns_per_word,
+                   p50, p99, max);
+            break;
+        case FORMAT_JSON:
+            printf("{\"algorithm\": \"%s\", \"encoding\": \"%s\", "
+                   "\"words\": %lu, \"bytes\": %lu, \"passes\": %ld, "
+                   "\"seconds\": %.3f, \"words_per_sec\": %.0f, "
+                   "\"mb_per_sec\": %.2f, \"ns_per_word\": %.1f, "
+                   "\"p50_ns\": %.0f, \"p99_ns\": %.0f, \"max_ns\": %.0f}\n",
+                   language, charenc,
+                   (unsigned long)words->count,
+                   (unsigned long)words->start[words->count], passes,
+                   elapsed * 1e-9, words_per_sec, mb_per_sec, ns_per_word,
+                   p50, p99, max);
+            break;
+    }
+}
+
+static void
+usage(int n)
+{
+    printf("usage: %s [-l <language>] [-i <input file>] [-c <character encoding>] [-n <iterations>] [-t <seconds>] [-f <format>] [-h]\n"
+          "\n"
+          "The input file consists of a list of words to be stemmed, one per\n"
+          "line, as for stemwords.  If omitted, stdin is used.  The words are\n"
+          "read into memory and then stemmed repeatedly, and the speed of the\n"
+          "stemmer is reported.\n"
+          "\n"
+          "If -c is given, the argument is the character encoding of the input\n"
+          "file.  If it is omitted, the UTF-8 encoding is used.\n"
+          "\n"
+          "If -n is given, the whole list is stemmed that many times.\n"
+          "Otherwise it is stemmed repeatedly for the number of seconds given\n"
+          "by -t (default 1).\n"
+          "\n"
+          "The latency percentiles come from a separate pass which times each\n"
+          "word individually (up to %d words).\n"
+          "\n"
+          "-f selects the format of the results: \"text\" (the default),\n"
+          "\"csv\" or \"json\".  In the machine-readable formats a single line is\n"
+          "output, with these fields in this order:\n"
+          "\n"
+          "    " CSV_HEADER "\n"
+          "\n"
+          "-h displays this help\n",
+          progname, MAX_SAMPLES);
+    exit(n);
+}
+
+int
+main(int argc, char * argv[])
+{
+    const char * in = NULL;
+    FILE * f_in;
+    struct sb_stemmer * stemmer;
+    struct word_list words;
+    double * samples;
+    size_t n_samples;
+    long iterations = 0;
+    double seconds = 1.0;
+    long passes;
+    double t0, elapsed;
+    enum format format = FORMAT_TEXT;
+
+    const char * language = "english";
+    const char * charenc = NULL;
+
+    int i = 1;
+
+    progname = argv[0];
+
+    while (i < argc) {
+        const char * s = argv[i++];
+        if (s[0] == '-') {
+            if (strcmp(s, "-i") == 0) {
+                if (i >= argc) {
+                    fprintf(stderr, "%s requires an argument\n", s);
+                    exit(1);
+                }
+                in = argv[i++];
+            } else if (strcmp(s, "-l") == 0) {
+                if (i >= argc) {
+                    fprintf(stderr, "%s requires an argument\n", s);
+                    exit(1);
+                }
+                language = argv[i++];
+            } else if (strcmp(s, "-c") == 0) {
+                if (i >= argc) {
+                    fprintf(stderr, "%s requires an argument\n", s);
+                    exit(1);
+                }
+                charenc = argv[i++];
+            } else if (strcmp(s, "-n") == 0) {
+                if (i >= argc) {
+                    fprintf(stderr, "%s requires an argument\n", s);
+                    exit(1);
+                }
+                iterations = atol(argv[i++]);
+                if (iterations < 1) {
+                    fprintf(stderr, "-n requires a positive number of iterations\n");
+                    exit(1);
+                }
+            } else if (strcmp(s, "-t") == 0) {
+                if (i >= argc) {
+                    fprintf(stderr, "%s requires an argument\n", s);
+                    exit(1);
+                }
+                seconds = atof(argv[i++]);
+                if (!(seconds > 0)) {
+                    fprintf(stderr, "-t requires a positive number of seconds\n");
+                    exit(1);
+                }
+            } else if (strcmp(s, "-f") == 0) {
+                if (i >= argc) {
+                    fprintf(stderr, "%s requires an argument\n", s);
+                    exit(1);
+                }
+                s = argv[i++];
+                if (strcmp(s, "text") == 0) {
+                    format = FORMAT_TEXT;
+                } else if (strcmp(s, "csv") == 0) {
+                    format = FORMAT_CSV;
+                } else if (strcmp(s, "json") == 0) {
+                    format = FORMAT_JSON;
+                } else {
+                    fprintf(stderr, "format `%s' unknown\n", s);
+                    exit(1);
+                }
+            } else if (strcmp(s, "-h") == 0) {
+                usage(0);
+            } else {
+                fprintf(stderr, "option %s unknown\n", s);
+                usage(1);
+            }
+        } else {
+            fprintf(stderr, "unexpected parameter %s\n", s);
+            usage(1);
+        }
+    }
+
+    stemmer = sb_stemmer_new(language, charenc);
+    if (stemmer == NULL) {
+        if (charenc == NULL) {
+            fprintf(stderr, "language `%s' not available for stemming\n", language);
+        } else {
+            fprintf(stderr, "language `%s' not available for stemming in encoding `%s'\n", language, charenc);
+        }
+        exit(1);
+    }
+
+    f_in = (in == NULL) ? stdin : fopen(in, "rb");
+    if (f_in == NULL) {
+        fprintf(stderr, "file %s not found\n", in);
+        exit(1);
+    }
+    read_words(f_in, &words);
+    if (in != NULL) fclose(f_in);
+    if (words.count == 0) {
+        fprintf(stderr, "no words to stem\n");
+        exit(1);
+    }
+
+    /* Warm up the caches and let the stemmer grow its buffers. */
+    stem_all(stemmer, &words);
+
+    passes = 0;
+    t0 = now_ns();
+    do {
+        stem_all(stemmer, &words);
+        ++passes;
+        elapsed = now_ns() - t0;
+    } while (iterations ? passes < iterations : elapsed < seconds * 1e9);
+    if (elapsed <= 0) elapsed = 1;
+
+    samples = (double *) malloc((words.count < MAX_SAMPLES ? words.count : MAX_SAMPLES) * sizeof(double));
+    if (samples == NULL) out_of_memory();
+    n_samples = time_words(stemmer, &words, samples);
+
+    report(format, language, charenc ? charenc : "UTF_8", &words,
+           passes, elapsed, samples, n_samples);
+
+    free(samples);
+    free(words.start);
+    free(words.text);
+    sb_stemmer_delete(stemmer);
+    return 0;
+}
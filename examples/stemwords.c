@@ -5,81 +5,323 @@
 #include <stdio.h>
 #include <stdlib.h> /* for malloc, free */
 #include <string.h> /* for memmove */
-#include <ctype.h>  /* for isupper, tolower */
+
+#if defined __unix__ || defined __unix || (defined __APPLE__ && defined __MACH__)
+# define HAVE_MMAP 1
+# define HAVE_PTHREAD 1
+# include <sys/mman.h>
+# include <sys/stat.h>
+# include <pthread.h>
+#endif
 
 #include "libstemmer.h"
 
 const char * progname;
 static int pretty = 1;
 
+/* Size of the output buffer, and of the blocks read from the input when it
+ * can't be mapped. */
+#define OUT_BUFFER_SIZE (1 << 20)
+#define IN_BLOCK_SIZE (1 << 16)
+
+/* With -j, the input is handed out to the threads in rounds, with each
+ * thread getting about this much of it per round. */
+#define CHUNK_SIZE (1 << 20)
+
+/* Maximum number of threads for -j. */
+#define MAX_JOBS 256
+
+/* Output goes either to a file, in which case the buffer is flushed when it
+ * fills, or (if f is NULL) just to the buffer, which grows as needed. */
+struct output {
+    FILE * f;
+    char * buf;
+    size_t used;
+    size_t size;
+};
+
+/* The state needed to stem lines.  With -j each thread has its own. */
+struct worker {
+    struct sb_stemmer * stemmer;
+    /* Buffer holding the current line, forced to lower case.  It grows
+     * geometrically, so long lines don't cause repeated reallocation. */
+    sb_symbol * line;
+    size_t line_size;
+    /* Where the output goes: the output file if there's only one worker,
+     * otherwise buffer, which is copied to the output file in order. */
+    struct output * out;
+    struct output buffer;
+    /* The lines for this thread to stem in the current round. */
+    const char * text;
+    size_t len;
+};
+
 static void
-stem_file(struct sb_stemmer * stemmer, FILE * f_in, FILE * f_out)
+out_of_memory(void)
 {
-#define INC 10
-    int lim = INC;
-    sb_symbol * b = (sb_symbol *) malloc(lim * sizeof(sb_symbol));
+    fprintf(stderr, "Out of memory or internal error\n");
+    exit(1);
+}
 
-    while (1) {
-        int ch = getc(f_in);
-        if (ch == EOF) {
-            free(b); return;
+static void
+out_init(struct output * out, FILE * f)
+{
+    out->f = f;
+    out->used = 0;
+    out->size = OUT_BUFFER_SIZE;
+    out->buf = (char *) malloc(out->size);
+    if (out->buf == NULL) out_of_memory();
+}
+
+static void
+out_write_file(FILE * f, const void * data, size_t len)
+{
+    if (len && fwrite(data, 1, len, f) != len) {
+        fprintf(stderr, "Error writing output\n");
+        exit(1);
+    }
+}
+
+static void
+out_flush(struct output * out)
+{
+    out_write_file(out->f, out->buf, out->used);
+    out->used = 0;
+}
+
+static void
+out_write(struct output * out, const void * data, size_t len)
+{
+    if (len > out->size - out->used) {
+        if (out->f == NULL) {
+            size_t new_size = out->size * 2;
+            char * new_buf;
+            while (new_size - out->used < len) new_size *= 2;
+            new_buf = (char *) realloc(out->buf, new_size);
+            if (new_buf == NULL) out_of_memory();
+            out->buf = new_buf;
+            out->size = new_size;
+        } else {
+            out_flush(out);
+            if (len > out->size) {
+                out_write_file(out->f, data, len);
+                return;
+            }
         }
-        {
-            int i = 0;
-            int inlen = 0;
-            while (ch != '\n' && ch != EOF) {
-                if (i == lim) {
-                    sb_symbol * newb;
-                    newb = (sb_symbol *)
-                            realloc(b, (lim + INC) * sizeof(sb_symbol));
-                    if (newb == NULL) goto error;
-                    b = newb;
-                    lim = lim + INC;
-                }
-                /* Update count of utf-8 characters. */
-                if (ch < 0x80 || ch > 0xBF) inlen += 1;
-                /* force lower case: */
-                ch = tolower(ch);
-
-                b[i] = ch;
-                i++;
-                ch = getc(f_in);
+    }
+    memcpy(out->buf + out->used, data, len);
+    out->used += len;
+}
+
+static void
+out_spaces(struct output * out, int n)
+{
+    while (n-- > 0) out_write(out, " ", 1);
+}
+
+static void
+stem_line(struct worker * w, const char * text, size_t len)
+{
+    struct output * out = w->out;
+    const sb_symbol * stemmed;
+    int inlen = 0;
+    size_t i;
+
+    if (len > w->line_size) {
+        size_t new_size = w->line_size ? w->line_size : 64;
+        sb_symbol * new_line;
+        while (new_size < len) new_size *= 2;
+        new_line = (sb_symbol *) realloc(w->line, new_size);
+        if (new_line == NULL) out_of_memory();
+        w->line = new_line;
+        w->line_size = new_size;
+    }
+    for (i = 0; i < len; i++) {
+        int ch = (unsigned char)text[i];
+        /* Update count of utf-8 characters. */
+        if (ch < 0x80 || ch > 0xBF) inlen += 1;
+        /* force lower case: */
+        if (ch >= 'A' && ch <= 'Z') ch += 'a' - 'A';
+        w->line[i] = ch;
+    }
+
+    stemmed = sb_stemmer_stem(w->stemmer, w->line, (int)len);
+    if (stemmed == NULL) out_of_memory();
+
+    if (pretty == 1) {
+        out_write(out, w->line, len);
+        out_write(out, " -> ", 4);
+    } else if (pretty == 2) {
+        out_write(out, w->line, len);
+        if (sb_stemmer_length(w->stemmer) > 0) {
+            if (inlen < 30) {
+                out_spaces(out, 30 - inlen);
+            } else {
+                out_write(out, "\n", 1);
+                out_spaces(out, 30);
             }
+        }
+    }
 
-            {
-                const sb_symbol * stemmed = sb_stemmer_stem(stemmer, b, i);
-                if (stemmed == NULL)
-                {
-                    fprintf(stderr, "Out of memory or internal error\n");
-                    exit(1);
-                }
+    out_write(out, stemmed, sb_stemmer_length(w->stemmer));
+    out_write(out, "\n", 1);
+}
 
-                if (pretty == 1) {
-                    fwrite(b, i, 1, f_out);
-                    fputs(" -> ", f_out);
-                } else if (pretty == 2) {
-                    fwrite(b, i, 1, f_out);
-                    if (sb_stemmer_length(stemmer) > 0) {
-                        int j;
-                        if (inlen < 30) {
-                            for (j = 30 - inlen; j > 0; j--)
-                                fputs(" ", f_out);
-                        } else {
-                            fputs("\n", f_out);
-                            for (j = 30; j > 0; j--)
-                                fputs(" ", f_out);
-                        }
-                    }
-                }
+/* Stem each complete line in text, and the final partial line too if at_end
+ * is set.  Returns the number of bytes used. */
+static size_t
+stem_lines(struct worker * w, const char * text, size_t len, int at_end)
+{
+    size_t pos = 0;
+    while (pos < len) {
+        const char * nl = (const char *) memchr(text + pos, '\n', len - pos);
+        size_t end;
+        if (nl == NULL) {
+            if (!at_end) break;
+            end = len;
+        } else {
+            end = nl - text;
+        }
+        stem_line(w, text + pos, end - pos);
+        pos = end + 1;
+    }
+    return pos < len ? pos : len;
+}
+
+#ifdef HAVE_PTHREAD
+static void *
+stem_chunk(void * arg)
+{
+    struct worker * w = (struct worker *)arg;
+    (void) stem_lines(w, w->text, w->len, 1);
+    return NULL;
+}
 
-                fputs((const char *)stemmed, f_out);
-                putc('\n', f_out);
+/* Stem text using all the workers, and write the output in input order.  The
+ * text must end at the end of a line (or of the input). */
+static void
+stem_parallel(struct worker * workers, int n_workers, const char * text,
+              size_t len, struct output * out)
+{
+    while (len > 0) {
+        pthread_t threads[MAX_JOBS];
+        int n = 0;
+        int i;
+        /* Hand out a line-aligned chunk to each worker in turn. */
+        while (len > 0 && n < n_workers) {
+            size_t chunk = len;
+            if (chunk > CHUNK_SIZE) {
+                const char * nl = (const char *)
+                    memchr(text + CHUNK_SIZE, '\n', len - CHUNK_SIZE);
+                if (nl) chunk = nl - text + 1;
             }
+            workers[n].text = text;
+            workers[n].len = chunk;
+            workers[n].buffer.used = 0;
+            text += chunk;
+            len -= chunk;
+            ++n;
+        }
+        for (i = 1; i < n; i++) {
+            if (pthread_create(&threads[i], NULL, stem_chunk, &workers[i]) != 0) {
+                /* Just do it in this thread instead. */
+                (void) stem_chunk(&workers[i]);
+                threads[i] = pthread_self();
+            }
+        }
+        (void) stem_chunk(&workers[0]);
+        out_write(out, workers[0].buffer.buf, workers[0].buffer.used);
+        for (i = 1; i < n; i++) {
+            if (!pthread_equal(threads[i], pthread_self())) {
+                (void) pthread_join(threads[i], NULL);
+            }
+            out_write(out, workers[i].buffer.buf, workers[i].buffer.used);
+        }
+    }
+}
+#endif
+
+/* Stem the lines in text, and the final partial line too if at_end is set.
+ * Returns the number of bytes used. */
+static size_t
+stem_text(struct worker * workers, int n_workers, const char * text,
+          size_t len, int at_end, struct output * out)
+{
+#ifdef HAVE_PTHREAD
+    if (n_workers > 1) {
+        size_t used = len;
+        if (!at_end) {
+            /* Only stem complete lines. */
+            while (used > 0 && text[used - 1] != '\n') --used;
+        }
+        stem_parallel(workers, n_workers, text, used, out);
+        return used;
+    }
+#else
+    (void) n_workers;
+#endif
+    return stem_lines(workers, text, len, at_end);
+}
+
+#ifdef HAVE_MMAP
+/* Stem a regular file by mapping it into memory.  Returns 0 if the file
+ * can't be mapped, so the caller should read it instead. */
+static int
+stem_mapped_file(struct worker * workers, int n_workers, FILE * f_in,
+                 struct output * out)
+{
+    struct stat st;
+    void * map;
+    if (fstat(fileno(f_in), &st) < 0 || !S_ISREG(st.st_mode)) return 0;
+    if (st.st_size == 0) return 1;
+    if ((unsigned long long)st.st_size > (size_t)-1) return 0;
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fileno(f_in), 0);
+    if (map == MAP_FAILED) return 0;
+#ifdef MADV_SEQUENTIAL
+    (void) madvise(map, st.st_size, MADV_SEQUENTIAL);
+#endif
+    (void) stem_text(workers, n_workers, (const char *)map, st.st_size, 1, out);
+    (void) munmap(map, st.st_size);
+    return 1;
+}
+#endif
+
+/* Stem f_in, writing the results to out. */
+static void
+stem_file(struct worker * workers, int n_workers, FILE * f_in,
+          struct output * out)
+{
+    char * buf;
+    /* With -j, read enough to keep all the threads busy. */
+    size_t block = n_workers > 1 ? (size_t)n_workers * CHUNK_SIZE : IN_BLOCK_SIZE;
+    size_t size = block;
+    size_t len = 0;
+
+#ifdef HAVE_MMAP
+    if (stem_mapped_file(workers, n_workers, f_in, out)) return;
+#endif
+
+    /* Read the input in blocks, keeping any partial line at the end of a
+     * block for the next time round.  The buffer doubles in size if a
+     * single line doesn't fit. */
+    buf = (char *) malloc(size);
+    if (buf == NULL) out_of_memory();
+    while (1) {
+        size_t n, used;
+        if (size - len < block / 2) {
+            char * new_buf = (char *) realloc(buf, size * 2);
+            if (new_buf == NULL) out_of_memory();
+            buf = new_buf;
+            size *= 2;
         }
+        n = fread(buf + len, 1, size - len, f_in);
+        len += n;
+        used = stem_text(workers, n_workers, buf, len, n == 0, out);
+        memmove(buf, buf + used, len - used);
+        len -= used;
+        if (n == 0) break;
     }
-error:
-    free(b);
-    return;
+    free(buf);
 }
 
 /** Display the command line syntax, and then exit.
@@ -88,7 +330,7 @@ error:
 static void
 usage(int n)
 {
-    printf("usage: %s [-l <language>] [-i <input file>] [-o <output file>] [-c <character encoding>] [-p[2]] [-h]\n"
+    printf("usage: %s [-l <language>] [-i <input file>] [-o <output file>] [-c <character encoding>] [-p[2]] [-j <threads>] [-h]\n"
           "\n"
           "The input file consists of a list of words to be stemmed, one per\n"
           "line. Words should be in lower case, but (for English) A-Z letters\n"
@@ -106,6 +348,9 @@ usage(int n)
           "Otherwise, the output file consists of the stemmed words, one per\n"
           "line.\n"
           "\n"
+          "If -j is given, the stemming is split between that many threads.\n"
+          "The output is the same as without -j.\n"
+          "\n"
           "-h displays this help\n",
           progname);
     exit(n);
@@ -118,7 +363,9 @@ main(int argc, char * argv[])
     const char * out = NULL;
     FILE * f_in;
     FILE * f_out;
-    struct sb_stemmer * stemmer;
+    struct output output;
+    struct worker * workers;
+    int n_workers = 1;
 
     const char * language = "english";
     const char * charenc = NULL;
@@ -155,6 +402,22 @@ main(int argc, char * argv[])
                     exit(1);
                 }
                 charenc = argv[i++];
+            } else if (strcmp(s, "-j") == 0) {
+                if (i >= argc) {
+                    fprintf(stderr, "%s requires an argument\n", s);
+                    exit(1);
+                }
+                n_workers = atoi(argv[i++]);
+                if (n_workers < 1 || n_workers > MAX_JOBS) {
+                    fprintf(stderr, "-j requires a number of threads between 1 and %d\n", MAX_JOBS);
+                    exit(1);
+                }
+#ifndef HAVE_PTHREAD
+                if (n_workers > 1) {
+                    fprintf(stderr, "warning: -j not supported on this platform\n");
+                    n_workers = 1;
+                }
+#endif
             } else if (strcmp(s, "-p2") == 0) {
                 pretty = 2;
             } else if (strcmp(s, "-p") == 0) {
@@ -184,18 +447,40 @@ main(int argc, char * argv[])
     }
 
     /* do the stemming process: */
-    stemmer = sb_stemmer_new(language, charenc);
-    if (stemmer == NULL) {
-        if (charenc == NULL) {
-            fprintf(stderr, "language `%s' not available for stemming\n", language);
-            exit(1);
+    out_init(&output, f_out);
+    workers = (struct worker *) malloc(n_workers * sizeof(struct worker));
+    if (workers == NULL) out_of_memory();
+    for (i = 0; i < n_workers; i++) {
+        struct worker * w = &workers[i];
+        w->stemmer = sb_stemmer_new(language, charenc);
+        if (w->stemmer == NULL) {
+            if (charenc == NULL) {
+                fprintf(stderr, "language `%s' not available for stemming\n", language);
+                exit(1);
+            } else {
+                fprintf(stderr, "language `%s' not available for stemming in encoding `%s'\n", language, charenc);
+                exit(1);
+            }
+        }
+        w->line = NULL;
+        w->line_size = 0;
+        if (n_workers == 1) {
+            w->out = &output;
+            w->buffer.buf = NULL;
         } else {
-            fprintf(stderr, "language `%s' not available for stemming in encoding `%s'\n", language, charenc);
-            exit(1);
+            out_init(&w->buffer, NULL);
+            w->out = &w->buffer;
         }
     }
-    stem_file(stemmer, f_in, f_out);
-    sb_stemmer_delete(stemmer);
+    stem_file(workers, n_workers, f_in, &output);
+    out_flush(&output);
+    free(output.buf);
+    for (i = 0; i < n_workers; i++) {
+        sb_stemmer_delete(workers[i].stemmer);
+        free(workers[i].line);
+        free(workers[i].buffer.buf);
+    }
+    free(workers);
 
     if (in != NULL) (void) fclose(f_in);
     if (out != NULL) (void) fclose(f_out);
@@ -5,6 +5,7 @@ extern "C" {
 #endif
 
 struct sb_stemmer;
+struct sb_stemmer_pool;
 typedef unsigned char sb_symbol;
 
 /* FIXME - should be able to get a version number for each stemming
@@ -45,6 +46,24 @@ const char ** sb_stemmer_list(void);
  */
 struct sb_stemmer * sb_stemmer_new(const char * algorithm, const char * charenc);
 
+/** Create a new stemmer object with a cache of recent results.
+ *
+ *  This is the same as sb_stemmer_new(), except that the stemmer remembers
+ *  the stems of up to @a capacity recently stemmed words, and returns the
+ *  remembered stem without running the stemming algorithm if the same word
+ *  is stemmed again.  Real text tends to repeat the same words a lot, so this
+ *  can greatly speed up stemming.  The cache is bounded - when full, it is
+ *  emptied and starts to fill again.
+ *
+ *  @param capacity The maximum number of words to cache.  If this is 0, no
+ *  cache is used.
+ *
+ *  @return As for sb_stemmer_new().
+ */
+struct sb_stemmer * sb_stemmer_new_cached(const char * algorithm,
+                                          const char * charenc,
+                                          int capacity);
+
 /** Delete a stemmer object.
  *
  *  This frees all resources allocated for the stemmer.  After calling
@@ -68,6 +87,10 @@ void                sb_stemmer_delete(struct sb_stemmer * stemmer);
  *  The length of the return value can be obtained using sb_stemmer_length().
  *
  *  If an out-of-memory error occurs, this will return NULL.
+ *
+ *  If libstemmer was compiled with SN_MAX_WORD_LENGTH defined, words which
+ *  don't fit in buffers of that size are returned unchanged (and if @a size
+ *  is more than SN_MAX_WORD_LENGTH the return value is @a word itself).
  */
 const sb_symbol *   sb_stemmer_stem(struct sb_stemmer * stemmer,
                                     const sb_symbol * word, int size);
@@ -77,6 +100,219 @@ const sb_symbol *   sb_stemmer_stem(struct sb_stemmer * stemmer,
  */
 int                 sb_stemmer_length(struct sb_stemmer * stemmer);
 
+/** Get the most bytes the stem of a word of @a size bytes can need.
+ *
+ *  This bound is worked out by the Snowball compiler from the algorithm, so
+ *  it can be used to size buffers for sb_stemmer_stem_into() or
+ *  sb_stemmer_stem_batch() up front.  It assumes that loops in the algorithm
+ *  which lengthen the word run at most once per character, which holds for
+ *  all the algorithms supplied.
+ *
+ *  While the stem is being worked out the word may temporarily be longer
+ *  than the stem which is returned, and the bound covers that too.
+ *
+ *  @return the bound, or -1 if the algorithm can't be bounded (or the bound
+ *  doesn't fit in an int).
+ */
+int                 sb_stemmer_max_output(struct sb_stemmer * stemmer,
+                                          int size);
+
+/** Stem a word into a buffer supplied by the caller.
+ *
+ *  This is like sb_stemmer_stem(), but the stem is written to @a out (without
+ *  a terminating nul) so it remains valid after the stemmer is next used.
+ *
+ *  @param out_size  The size of @a out in bytes.
+ *
+ *  @return the length of the stem.  If this is greater than @a out_size then
+ *  nothing has been written to @a out, and the call can be repeated with a
+ *  large enough buffer.  If an out-of-memory error occurs, -1 is returned.
+ */
+int                 sb_stemmer_stem_into(struct sb_stemmer * stemmer,
+                                         const sb_symbol * word, int size,
+                                         sb_symbol * out, int out_size);
+
+/** Stem a word, returning the stem as an edit of the input word.
+ *
+ *  Stemming usually only changes the end of a word, so the stem is reported
+ *  as the first *prefix_len bytes of @a word followed by the *suffix_len
+ *  bytes pointed to by the return value.  In the common case where
+ *  *suffix_len is 0 the stem is just a prefix of the input and the caller
+ *  need not copy anything.
+ *
+ *  The return value is owned by the stemmer, as for sb_stemmer_stem().
+ *
+ *  If an out-of-memory error occurs, this will return NULL.
+ */
+const sb_symbol *   sb_stemmer_stem_suffix(struct sb_stemmer * stemmer,
+                                           const sb_symbol * word, int size,
+                                           int * prefix_len,
+                                           int * suffix_len);
+
+/** Stem a batch of words.
+ *
+ *  Stems @a count words in a single call, writing the stems one after
+ *  another into the caller-supplied buffer @a out.  The stems are not
+ *  nul-terminated - instead, the stem of words[i] occupies
+ *  out[offsets[i]] to out[offsets[i + 1] - 1], so @a offsets must have room
+ *  for count + 1 entries.
+ *
+ *  This gives the same results as calling sb_stemmer_stem() for each word in
+ *  turn, but avoids the per-call overhead.
+ *
+ *  @param words  Array of @a count pointers to the words to stem.
+ *  @param sizes  Array of @a count word lengths (in bytes).
+ *  @param out_size  The size of @a out in bytes.
+ *
+ *  @return the number of words stemmed.  If this is less than @a count then
+ *  @a out is full, and the call can be repeated for the remaining words
+ *  (with a fresh buffer).  If an out-of-memory error occurs, -1 is returned.
+ */
+int                 sb_stemmer_stem_batch(struct sb_stemmer * stemmer,
+                                          int count,
+                                          const sb_symbol * const * words,
+                                          const int * sizes,
+                                          sb_symbol * out, int out_size,
+                                          int * offsets);
+
+/** Callback for sb_stemmer_stem_text().
+ *
+ *  @param context  The @a context pointer passed to sb_stemmer_stem_text().
+ *  @param offset  Offset in bytes of the token in the text.
+ *  @param length  Length in bytes of the token in the text.
+ *  @param stem  The stem of the case-folded token, which is only valid until
+ *  the callback returns.
+ *  @param stem_length  Length of the stem in bytes.
+ *
+ *  @return 0 to continue, or non-zero to stop after this token.
+ */
+typedef int (*sb_stemmer_text_callback)(void * context,
+                                        int offset, int length,
+                                        const sb_symbol * stem,
+                                        int stem_length);
+
+/** Split text into words and stem each one.
+ *
+ *  Makes a single pass over @a text, splitting it into tokens, converting
+ *  each to lower case and stemming it, and calling @a callback for each.
+ *
+ *  A token is a run of letters and digits, with an apostrophe included when
+ *  it is between two of these.  For a UTF-8 stemmer the text is decoded as
+ *  UTF-8.  Common punctuation and symbols separate tokens, as do invalid
+ *  UTF-8 sequences.  Case folding covers the Latin, Greek, Cyrillic and
+ *  Armenian letters.  For other character encodings, only ASCII letters are
+ *  folded, and every byte from 0x80 up is treated as a letter.
+ *
+ *  @param size  The length of @a text in bytes.
+ *  @param context  Passed through to @a callback.
+ *
+ *  @return the number of tokens passed to @a callback, or -1 if an out of
+ *  memory error occurs.
+ */
+int                 sb_stemmer_stem_text(struct sb_stemmer * stemmer,
+                                         const sb_symbol * text, int size,
+                                         sb_stemmer_text_callback callback,
+                                         void * context);
+
+/** Get the cache statistics for a stemmer.
+ *
+ *  Sets *hits and *misses to the number of lookups in the stemmer's cache
+ *  which found and didn't find the word respectively.  For a stemmer created
+ *  without a cache both are set to 0.
+ */
+void                sb_stemmer_cache_stats(struct sb_stemmer * stemmer,
+                                           unsigned long * hits,
+                                           unsigned long * misses);
+
+/** Usage statistics for a stemmer, as returned by sb_stemmer_stats(). */
+struct sb_stemmer_stats {
+    /** Number of words stemmed, including those found in the cache. */
+    unsigned long words;
+    /** Total length in bytes of the words stemmed. */
+    unsigned long input_bytes;
+    /** Total length in bytes of the stems returned. */
+    unsigned long output_bytes;
+    /** Number of words for which the stem was the same as the word. */
+    unsigned long unchanged;
+    /** Number of times one of the stemmer's internal buffers had to grow. */
+    unsigned long reallocs;
+    /** Cache lookups, as reported by sb_stemmer_cache_stats(). */
+    unsigned long cache_hits;
+    unsigned long cache_misses;
+    /** Time spent stemming in seconds, which is only counted while enabled
+     *  by sb_stemmer_time_stats(). */
+    double seconds;
+};
+
+/** Get the usage statistics for a stemmer.
+ *
+ *  The counters cover every word stemmed by any of the functions above since
+ *  the stemmer was created or the statistics were last reset.  Updating them
+ *  is cheap, so they're always kept.  The counters belong to the stemmer
+ *  object and aren't atomic, so for a pool each stemmer has its own.
+ */
+void                sb_stemmer_stats(struct sb_stemmer * stemmer,
+                                     struct sb_stemmer_stats * stats);
+
+/** Reset all the usage statistics for a stemmer (including the cache
+ *  statistics) to zero.
+ */
+void                sb_stemmer_reset_stats(struct sb_stemmer * stemmer);
+
+/** Enable or disable timing of stemming operations.
+ *
+ *  Timing is disabled by default as reading the clock for every word adds a
+ *  noticeable cost.
+ *
+ *  @param enable  Non-zero to add the time taken by each call to
+ *  stats.seconds, or zero to stop doing so.
+ */
+void                sb_stemmer_time_stats(struct sb_stemmer * stemmer,
+                                          int enable);
+
+/** Create a pool of stemmers which can be shared between threads.
+ *
+ *  A stemmer object can't be used concurrently from different threads, but
+ *  a pool can.  Each thread takes a stemmer from the pool with
+ *  sb_stemmer_pool_acquire(), uses it, and hands it back with
+ *  sb_stemmer_pool_release().  Neither operation takes a lock, and stemmers
+ *  are reused so there's usually no cost to create them.
+ *
+ *  @param algorithm,charenc As for sb_stemmer_new().
+ *
+ *  @param size The maximum number of idle stemmers to keep in the pool -
+ *  this should usually be the number of threads which will use it.
+ *
+ *  @return NULL if the algorithm and encoding aren't available, if an out of
+ *  memory error occurs, or if the library was built without support for
+ *  atomic operations.  Otherwise returns a pointer to a new pool, which must
+ *  be deleted by calling sb_stemmer_pool_delete().
+ */
+struct sb_stemmer_pool * sb_stemmer_pool_new(const char * algorithm,
+                                             const char * charenc,
+                                             int size);
+
+/** Delete a pool of stemmers.
+ *
+ *  All stemmers acquired from the pool must have been released first.
+ *  It is safe to pass a null pointer to this function - this will have
+ *  no effect.
+ */
+void                sb_stemmer_pool_delete(struct sb_stemmer_pool * pool);
+
+/** Take a stemmer from a pool for the exclusive use of the calling thread.
+ *
+ *  @return a stemmer, or NULL if an out of memory error occurs.
+ */
+struct sb_stemmer * sb_stemmer_pool_acquire(struct sb_stemmer_pool * pool);
+
+/** Return a stemmer taken by sb_stemmer_pool_acquire() to the pool.
+ *
+ *  The stemmer must not be used by the caller after this call.
+ */
+void                sb_stemmer_pool_release(struct sb_stemmer_pool * pool,
+                                            struct sb_stemmer * stemmer);
+
 #ifdef __cplusplus
 }
 #endif
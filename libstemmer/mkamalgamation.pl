@@ -0,0 +1,116 @@
+#!/usr/bin/env perl
+use strict;
+use 5.006;
+use warnings;
+
+# Combine the C runtime, the generated stemmers and libstemmer into a single
+# C source file which is compiled together with libstemmer.h.
+#
+# The sources are concatenated in the order given, with the #include lines
+# for the project's own headers and any `#if 0' blocks removed.  Everything
+# declared `extern' outside libstemmer.c is made static, so the compiler can
+# inline the runtime functions into the stemmers without link-time
+# optimisation, and prototypes for functions which are then never defined
+# (such as debug()) are dropped.  A repeated struct definition is dropped too
+# (code generated with -struct-env defines the struct in both the .c and .h).
+#
+# The static names in each generated stemmer (r_*, s_*, a_*, g_* and so on)
+# are only unique within that stemmer, so they're given the prefix of its
+# external functions.
+
+my $progname = $0;
+
+if (scalar @ARGV < 2) {
+  print "Usage: $progname <outfile> <source or header file>...\n";
+  exit 1;
+}
+
+my $outname = shift(@ARGV);
+my @srcfiles = @ARGV;
+
+sub readfile($)
+{
+    my $file = shift();
+    local $/;
+    open (IN, "<$file") or die "Can't open input file `$file': $!\n";
+    my $text = <IN>;
+    close IN;
+    return $text;
+}
+
+# Prefix the file-scope static names in a generated stemmer.
+sub prefixstatics($$)
+{
+    my $file = shift();
+    my $text = shift();
+
+    $text =~ m/^extern\s+int\s+(\w+_)stem\(/m
+        or die "Can't find the stem function in `$file'\n";
+    my $prefix = $1;
+    my %names = ();
+    while ($text =~ m/^static\b[^=(\[;]*?\b([A-Za-z_]\w*)\s*[\[(=;]/mg) {
+        $names{$1} = 1;
+    }
+    if (%names) {
+        my $re = join('|', sort keys %names);
+        $text =~ s/\b($re)\b/$prefix$1/g;
+    }
+    return $text;
+}
+
+sub printoutput()
+{
+    open (OUT, ">$outname") or die "Can't open output file `$outname': $!\n";
+
+    print OUT <<EOS;
+/* $outname: Snowball stemming library as a single C source file.
+ *
+ * This file is generated by mkamalgamation.pl from the C runtime, the
+ * generated stemmers and libstemmer.c.  Do not edit manually.
+ *
+ * Compile it with libstemmer.h in the include path.  Only the functions
+ * declared in libstemmer.h are visible outside this file.
+ */
+
+/* Used in place of `extern' for everything else. */
+#ifndef SN_PRIVATE
+# if defined __GNUC__
+#  define SN_PRIVATE static __attribute__((unused))
+# else
+#  define SN_PRIVATE static
+# endif
+#endif
+
+#include "libstemmer.h"
+EOS
+
+    my $all = '';
+    my %structs = ();
+    my $file;
+    foreach $file (@srcfiles) {
+        my $text = readfile($file);
+        # libstemmer.h is included above, and the other headers are in
+        # this file.
+        $text =~ s/^#include\s+"[^"]*"[^\n]*\n//mg;
+        $text =~ s/^#if 0\n.*?^#endif[^\n]*\n//mgs;
+        $text =~ s/^struct\s+(\w+)\s*\{\n.*?^\};\n/$structs{$1}++ ? '' : $&/mgse;
+        if ($file =~ m/(?:^|\/)stem_[^\/]*\.c$/) {
+            $text = prefixstatics($file, $text);
+        }
+        if ($file !~ m/(?:^|\/)libstemmer[^\/]*\.c$/) {
+            $text =~ s/^extern(?=\s+[^"\s])/SN_PRIVATE/mg;
+        }
+        $all .= "\n/************** $file **************/\n\n" . $text;
+    }
+
+    my %defined = ();
+    while ($all =~ m/^SN_PRIVATE\b[^;{]*?\b(\w+)\s*\([^;{]*\)\s*\{/mg) {
+        $defined{$1} = 1;
+    }
+    $all =~ s/^SN_PRIVATE\b[^;{]*?\b(\w+)\s*\([^;{]*\);\n/exists $defined{$1} ? $& : ''/mge;
+
+    print OUT $all;
+    close OUT or die "Can't close ${outname}: $!\n";
+}
+
+printoutput();
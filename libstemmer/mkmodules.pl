@@ -150,6 +150,8 @@ struct stemmer_modules {
   struct SN_env * (*create)(void);
   void (*close)(struct SN_env *);
   int (*stem)(struct SN_env *);
+  int (*stem_ascii)(struct SN_env *);
+  int (*max_length)(int);
 };
 static const struct stemmer_modules modules[] = {
 EOS
@@ -160,12 +162,13 @@ EOS
         my $enc;
         foreach $enc (sort keys (%$hashref)) {
             my $p = "${l}_${enc}";
-            print OUT "  {\"$lang\", ENC_$enc, ${p}_create_env, ${p}_close_env, ${p}_stem},\n";
+            my $ascii = $enc eq 'UTF_8' ? "${p}_stem_ascii" : "0";
+            print OUT "  {\"$lang\", ENC_$enc, ${p}_create_env, ${p}_close_env, ${p}_stem, $ascii, ${p}_max_length},\n";
         }
     }
 
     print OUT <<EOS;
-  {0,ENC_UNKNOWN,0,0,0}
+  {0,ENC_UNKNOWN,0,0,0,0,0}
 };
 EOS
 
@@ -1,41 +1,64 @@
 
-#include <stdlib.h> /* for malloc, calloc, free */
+#include <stdlib.h> /* for malloc, free */
 #include "header.h"
 
+/* Round n up to a multiple of a (which must be a power of 2). */
+#define ALIGN_UP(n, a) (((n) + (a) - 1) & ~((size_t)(a) - 1))
+
+#define ARENA_STRING_BYTES(capacity) \
+    ALIGN_UP(HEAD + ((capacity) + 1) * sizeof(symbol), sizeof(int))
+
+static symbol * arena_s(char * mem, int capacity) {
+    symbol * p = (symbol *) (HEAD + mem);
+    IN_ARENA(p) = 1;
+    CAPACITY(p) = capacity;
+    SET_SIZE(p, 0);
+    return p;
+}
+
+/* The env, the S[] and I[] vectors, and the initial string buffers are all
+ * carved out of a single allocation.  Strings which outgrow their initial
+ * buffer are moved to the heap by increase_size().
+ */
 extern struct SN_env * SN_create_env(int S_size, int I_size)
 {
     static const struct SN_env default_SN_env = {};
-    struct SN_env * z = (struct SN_env *) malloc(sizeof(struct SN_env));
-    if (z == NULL) return NULL;
+    struct SN_env * z;
+    char * mem;
+    size_t S_offset = ALIGN_UP(sizeof(struct SN_env), sizeof(symbol *));
+    size_t I_offset = S_offset + S_size * sizeof(symbol *);
+    size_t p_offset = ALIGN_UP(I_offset + I_size * sizeof(int), sizeof(int));
+    size_t s_offset = p_offset + ARENA_STRING_BYTES(SN_WORD_CAPACITY);
+    size_t total = s_offset + S_size * ARENA_STRING_BYTES(SN_STRING_CAPACITY);
+    int i;
+
+    mem = (char *) malloc(total);
+    if (mem == NULL) return NULL;
+    z = (struct SN_env *) mem;
     *z = default_SN_env;
-    z->p = create_s();
-    if (z->p == NULL) goto error;
+    z->p = arena_s(mem + p_offset, SN_WORD_CAPACITY);
     if (S_size)
     {
-        int i;
-        z->S = (symbol * *) malloc(S_size * sizeof(symbol *));
-        if (z->S == NULL) goto error;
-
+        z->S = (symbol * *) (mem + S_offset);
         for (i = 0; i < S_size; i++)
         {
-            z->S[i] = create_s();
-            if (z->S[i] == NULL) {
-                S_size = i;
-                goto error;
-            }
+            z->S[i] = arena_s(mem + s_offset, SN_STRING_CAPACITY);
+            s_offset += ARENA_STRING_BYTES(SN_STRING_CAPACITY);
         }
     }
 
     if (I_size)
     {
-        z->I = (int *) calloc(I_size, sizeof(int));
-        if (z->I == NULL) goto error;
+        z->I = (int *) (mem + I_offset);
+        for (i = 0; i < I_size; i++) z->I[i] = 0;
     }
 
     return z;
-error:
-    SN_close_env(z, S_size);
-    return NULL;
+}
+
+extern symbol * SN_init_s(int * buf, int capacity)
+{
+    return arena_s((char *) buf, capacity);
 }
 
 extern void SN_close_env(struct SN_env * z, int S_size)
@@ -48,10 +71,8 @@ extern void SN_close_env(struct SN_env * z, int S_size)
         {
             lose_s(z->S[i]);
         }
-        free(z->S);
     }
-    free(z->I);
-    if (z->p) lose_s(z->p);
+    lose_s(z->p);
     free(z);
 }
 
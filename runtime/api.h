@@ -1,3 +1,8 @@
+#ifndef SN_API_H
+#define SN_API_H
+
+/* This header may be included more than once, since it's included by the
+ * headers generated with -struct-env as well as by header.h. */
 
 typedef unsigned char symbol;
 
@@ -5,7 +10,7 @@ typedef unsigned char symbol;
 
    More precisely, replace 'char' with whatever type guarantees the
    character width you need. Note however that sizeof(symbol) should divide
-   HEAD, defined in header.h as 2*sizeof(int), without remainder, otherwise
+   HEAD, defined in header.h as 3*sizeof(int), without remainder, otherwise
    there is an alignment problem. In the unlikely event of a problem here,
    consult Martin Porter.
 
@@ -17,6 +22,8 @@ struct SN_env {
     int af;
     symbol * * S;
     int * I;
+    /* Number of times a string buffer has had to grow. */
+    unsigned long reallocs;
 };
 
 #ifdef __cplusplus
@@ -28,6 +35,49 @@ extern void SN_close_env(struct SN_env * z, int S_size);
 
 extern int SN_set_current(struct SN_env * z, int size, const symbol * s);
 
+/* Define SN_MAX_WORD_LENGTH (when compiling the runtime, the generated
+ * stemmers and libstemmer) to stem in fixed-size buffers.  Every string buffer
+ * in an env then holds SN_MAX_WORD_LENGTH symbols and is never grown, so
+ * stemming a word never calls malloc or realloc.  A change which would make
+ * the word longer than that fails with an error from replace_s() instead,
+ * leaving the buffer as it was.  libstemmer returns such words, and words
+ * which are longer than SN_MAX_WORD_LENGTH to start with, unchanged.
+ */
+
+/* Capacities of the word buffer and the string variables, in the env
+ * SN_create_env() allocates and in the state structs generated with
+ * -struct-env.  Most words fit without needing to grow the buffer, and
+ * longer strings are moved to the heap.  With SN_MAX_WORD_LENGTH buffers are
+ * never grown, and a string variable can hold any slice of the word, so all
+ * must hold the longest word.
+ *
+ * The struct is declared in the stemmer's header, so these set its layout for
+ * callers as well as for the stemmer itself, and everything must agree on
+ * them.  They're therefore not overridable, and SN_MAX_WORD_LENGTH has to be
+ * defined the same way for callers which use the struct as for the stemmer.
+ */
+#if defined SN_WORD_CAPACITY || defined SN_STRING_CAPACITY
+# error "SN_WORD_CAPACITY and SN_STRING_CAPACITY can't be overridden"
+#endif
+#ifdef SN_MAX_WORD_LENGTH
+# define SN_WORD_CAPACITY SN_MAX_WORD_LENGTH
+# define SN_STRING_CAPACITY SN_MAX_WORD_LENGTH
+#else
+# define SN_WORD_CAPACITY 64
+# define SN_STRING_CAPACITY 16
+#endif
+
+/* Size in ints of a buffer for a string of up to n symbols (including the
+ * 3 ints of header in front of the string). */
+#define SN_BUFFER_INTS(n) \
+    (3 + (((n) + 1) * sizeof(symbol) + sizeof(int) - 1) / sizeof(int))
+
+/* Set up buf, which must have SN_BUFFER_INTS(capacity) elements, to hold a
+ * string, returning a pointer to the (empty) string. */
+extern symbol * SN_init_s(int * buf, int capacity);
+
 #ifdef __cplusplus
 }
 #endif
+
+#endif
@@ -1,11 +1,23 @@
 
+#include <string.h>
+
 #include "api.h"
 
-#define HEAD 2*sizeof(int)
+#define HEAD 3*sizeof(int)
 
 #define SIZE(p)        ((int *)(p))[-1]
 #define SET_SIZE(p, n) ((int *)(p))[-1] = n
 #define CAPACITY(p)    ((int *)(p))[-2]
+/* Non-zero if the buffer is part of an SN_env's arena allocation (so it
+ * mustn't be passed to realloc() or free()). */
+#define IN_ARENA(p)    ((int *)(p))[-3]
+
+/* Branch prediction hint, used by code generated with -profile-use. */
+#if defined __GNUC__
+# define SN_LIKELY(X) __builtin_expect(!!(X), 1)
+#else
+# define SN_LIKELY(X) (X)
+#endif
 
 struct among
 {
@@ -21,6 +33,36 @@ struct among
     int function;
 };
 
+/* Trie of the strings in an among, as generated by the -trie option.  Edge j
+ * leads to node j + 1, and the edges from node n are start[n] to
+ * start[n + 1] - 1 (sorted by character). */
+struct among_trie
+{
+    const unsigned short * start;
+    /* Character for each edge. */
+    const symbol * ch;
+    /* For each node, 1 + index of the among entry ending there, or 0. */
+    const unsigned short * entry;
+};
+
+/* Entry in the packed among tables generated by the -packed option.  The
+ * search strings are stored in a single array (the pool) and referred to by
+ * offset, so the table holds no pointers and needs no relocations in a shared
+ * library. */
+struct among_packed
+{
+    /* Offset of the search string in the pool. */
+    unsigned short s;
+    /* Number of symbols in the search string. */
+    unsigned char s_size;
+    /* Optional condition routine index, or 0 if none. */
+    unsigned char function;
+    /* 1 + index of longest matching substring, or 0 if none. */
+    unsigned short substring;
+    /* Result of the lookup. */
+    short result;
+};
+
 extern symbol * create_s(void);
 extern void lose_s(symbol * p);
 
@@ -38,6 +80,19 @@ extern int in_grouping_b(struct SN_env * z, const unsigned char * s, int min, in
 extern int out_grouping(struct SN_env * z, const unsigned char * s, int min, int max, int repeat);
 extern int out_grouping_b(struct SN_env * z, const unsigned char * s, int min, int max, int repeat);
 
+/* As above, but testing membership via a lookup table with one entry per byte
+ * value.  For UTF-8 the table only covers ASCII, and characters from U+0080 up
+ * are tested against the bitmap s as for in_grouping_U and friends. */
+extern int in_grouping_T(struct SN_env * z, const unsigned char * t, int repeat);
+extern int in_grouping_b_T(struct SN_env * z, const unsigned char * t, int repeat);
+extern int out_grouping_T(struct SN_env * z, const unsigned char * t, int repeat);
+extern int out_grouping_b_T(struct SN_env * z, const unsigned char * t, int repeat);
+
+extern int in_grouping_TU(struct SN_env * z, const unsigned char * t, const unsigned char * s, int min, int max, int repeat);
+extern int in_grouping_b_TU(struct SN_env * z, const unsigned char * t, const unsigned char * s, int min, int max, int repeat);
+extern int out_grouping_TU(struct SN_env * z, const unsigned char * t, const unsigned char * s, int min, int max, int repeat);
+extern int out_grouping_b_TU(struct SN_env * z, const unsigned char * t, const unsigned char * s, int min, int max, int repeat);
+
 extern int eq_s(struct SN_env * z, int s_size, const symbol * s);
 extern int eq_s_b(struct SN_env * z, int s_size, const symbol * s);
 extern int eq_v(struct SN_env * z, const symbol * p);
@@ -48,6 +103,27 @@ extern int find_among(struct SN_env * z, const struct among * v, int v_size,
 extern int find_among_b(struct SN_env * z, const struct among * v, int v_size,
                         int (*)(struct SN_env *));
 
+extern int find_among_trie(struct SN_env * z, const struct among * v,
+                           const struct among_trie * t,
+                           int (*)(struct SN_env *));
+extern int find_among_trie_b(struct SN_env * z, const struct among * v,
+                             const struct among_trie * t,
+                             int (*)(struct SN_env *));
+
+extern int find_among_packed(struct SN_env * z, const struct among_packed * v,
+                             const symbol * pool, int v_size,
+                             int (*)(struct SN_env *));
+extern int find_among_packed_b(struct SN_env * z,
+                               const struct among_packed * v,
+                               const symbol * pool, int v_size,
+                               int (*)(struct SN_env *));
+
+/* Only used by code generated with -profile. */
+extern int find_among_p(struct SN_env * z, const struct among * v, int v_size,
+                        int (*)(struct SN_env *), unsigned long * counts);
+extern int find_among_b_p(struct SN_env * z, const struct among * v, int v_size,
+                          int (*)(struct SN_env *), unsigned long * counts);
+
 extern int replace_s(struct SN_env * z, int c_bra, int c_ket, int s_size, const symbol * s, int * adjustment);
 extern int slice_from_s(struct SN_env * z, int s_size, const symbol * s);
 extern int slice_from_v(struct SN_env * z, const symbol * p);
@@ -62,3 +138,192 @@ extern symbol * assign_to(struct SN_env * z, symbol * p);
 extern int len_utf8(const symbol * p);
 
 extern void debug(struct SN_env * z, int number, int line_count);
+
+/* Inline versions of the grouping tests and of eq_s(), eq_s_b() and
+ * slice_from_s(), used by code generated with -inline.  The tables, the
+ * limits of the grouping and the length of the string are then constants,
+ * so the compiler can specialise the code for each call.  The UTF-8 grouping
+ * tests only handle ASCII characters inline, and leave the rest to the
+ * out-of-line functions. */
+#if defined __cplusplus || (defined __STDC_VERSION__ && __STDC_VERSION__ >= 199901L)
+# define SN_INLINE static inline
+#elif defined __GNUC__ || defined _MSC_VER
+# define SN_INLINE static __inline
+#else
+# define SN_INLINE static
+#endif
+
+/* With repeat set these scan the whole run of characters in (or not in) the
+ * grouping using locals, and only write back z->c at the end. */
+
+SN_INLINE int in_grouping_T_i(struct SN_env * z, const unsigned char * t, int repeat) {
+    const symbol * p = z->p;
+    int c = z->c;
+    int l = z->l;
+    if (!repeat) {
+        if (c >= l) return -1;
+        if (!t[p[c]]) return 1;
+        z->c = c + 1;
+        return 0;
+    }
+    while (c < l && t[p[c]]) c++;
+    z->c = c;
+    return c < l ? 1 : -1;
+}
+
+SN_INLINE int out_grouping_T_i(struct SN_env * z, const unsigned char * t, int repeat) {
+    const symbol * p = z->p;
+    int c = z->c;
+    int l = z->l;
+    if (!repeat) {
+        if (c >= l) return -1;
+        if (t[p[c]]) return 1;
+        z->c = c + 1;
+        return 0;
+    }
+    while (c < l && !t[p[c]]) c++;
+    z->c = c;
+    return c < l ? 1 : -1;
+}
+
+SN_INLINE int in_grouping_b_T_i(struct SN_env * z, const unsigned char * t, int repeat) {
+    const symbol * p = z->p;
+    int c = z->c;
+    int lb = z->lb;
+    if (!repeat) {
+        if (c <= lb) return -1;
+        if (!t[p[c - 1]]) return 1;
+        z->c = c - 1;
+        return 0;
+    }
+    while (c > lb && t[p[c - 1]]) c--;
+    z->c = c;
+    return c > lb ? 1 : -1;
+}
+
+SN_INLINE int out_grouping_b_T_i(struct SN_env * z, const unsigned char * t, int repeat) {
+    const symbol * p = z->p;
+    int c = z->c;
+    int lb = z->lb;
+    if (!repeat) {
+        if (c <= lb) return -1;
+        if (t[p[c - 1]]) return 1;
+        z->c = c - 1;
+        return 0;
+    }
+    while (c > lb && !t[p[c - 1]]) c--;
+    z->c = c;
+    return c > lb ? 1 : -1;
+}
+
+SN_INLINE int in_grouping_TU_i(struct SN_env * z, const unsigned char * t, const unsigned char * s, int min, int max, int repeat) {
+    const symbol * p = z->p;
+    int c = z->c;
+    int l = z->l;
+    do {
+        if (c >= l) {
+            z->c = c;
+            return -1;
+        }
+        if (p[c] >= 0x80) {
+            z->c = c;
+            return in_grouping_TU(z, t, s, min, max, repeat);
+        }
+        if (!t[p[c]]) {
+            z->c = c;
+            return 1;
+        }
+        c++;
+    } while (repeat);
+    z->c = c;
+    return 0;
+}
+
+SN_INLINE int out_grouping_TU_i(struct SN_env * z, const unsigned char * t, const unsigned char * s, int min, int max, int repeat) {
+    const symbol * p = z->p;
+    int c = z->c;
+    int l = z->l;
+    do {
+        if (c >= l) {
+            z->c = c;
+            return -1;
+        }
+        if (p[c] >= 0x80) {
+            z->c = c;
+            return out_grouping_TU(z, t, s, min, max, repeat);
+        }
+        if (t[p[c]]) {
+            z->c = c;
+            return 1;
+        }
+        c++;
+    } while (repeat);
+    z->c = c;
+    return 0;
+}
+
+SN_INLINE int in_grouping_b_TU_i(struct SN_env * z, const unsigned char * t, const unsigned char * s, int min, int max, int repeat) {
+    const symbol * p = z->p;
+    int c = z->c;
+    int lb = z->lb;
+    do {
+        if (c <= lb) {
+            z->c = c;
+            return -1;
+        }
+        if (p[c - 1] >= 0x80) {
+            z->c = c;
+            return in_grouping_b_TU(z, t, s, min, max, repeat);
+        }
+        if (!t[p[c - 1]]) {
+            z->c = c;
+            return 1;
+        }
+        c--;
+    } while (repeat);
+    z->c = c;
+    return 0;
+}
+
+SN_INLINE int out_grouping_b_TU_i(struct SN_env * z, const unsigned char * t, const unsigned char * s, int min, int max, int repeat) {
+    const symbol * p = z->p;
+    int c = z->c;
+    int lb = z->lb;
+    do {
+        if (c <= lb) {
+            z->c = c;
+            return -1;
+        }
+        if (p[c - 1] >= 0x80) {
+            z->c = c;
+            return out_grouping_b_TU(z, t, s, min, max, repeat);
+        }
+        if (t[p[c - 1]]) {
+            z->c = c;
+            return 1;
+        }
+        c--;
+    } while (repeat);
+    z->c = c;
+    return 0;
+}
+
+SN_INLINE int eq_s_i(struct SN_env * z, int s_size, const symbol * s) {
+    if (z->l - z->c < s_size || memcmp(z->p + z->c, s, s_size * sizeof(symbol)) != 0) return 0;
+    z->c += s_size; return 1;
+}
+
+SN_INLINE int eq_s_b_i(struct SN_env * z, int s_size, const symbol * s) {
+    if (z->c - z->lb < s_size || memcmp(z->p + z->c - s_size, s, s_size * sizeof(symbol)) != 0) return 0;
+    z->c -= s_size; return 1;
+}
+
+SN_INLINE int slice_from_s_i(struct SN_env * z, int s_size, const symbol * s) {
+    /* A replacement of the same length needs no change to the buffer size or
+     * the cursor, so just copy it in. */
+    if (z->ket - z->bra == s_size && z->bra >= 0 && z->ket <= z->l) {
+        memmove(z->p + z->bra, s, s_size * sizeof(symbol));
+        return 0;
+    }
+    return slice_from_s(z, s_size, s);
+}
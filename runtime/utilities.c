@@ -12,13 +12,14 @@ extern symbol * create_s(void) {
     void * mem = malloc(HEAD + (CREATE_SIZE + 1) * sizeof(symbol));
     if (mem == NULL) return NULL;
     p = (symbol *) (HEAD + (char *) mem);
+    IN_ARENA(p) = 0;
     CAPACITY(p) = CREATE_SIZE;
     SET_SIZE(p, 0);
     return p;
 }
 
 extern void lose_s(symbol * p) {
-    if (p == NULL) return;
+    if (p == NULL || IN_ARENA(p)) return;
     free((char *) p - HEAD);
 }
 
@@ -217,14 +218,158 @@ extern int out_grouping_b(struct SN_env * z, const unsigned char * s, int min, i
     return 0;
 }
 
+/* Code for character groupings: lookup table cases.  These are defined
+ * inline in header.h. */
+
+extern int in_grouping_T(struct SN_env * z, const unsigned char * t, int repeat) {
+    return in_grouping_T_i(z, t, repeat);
+}
+
+extern int in_grouping_b_T(struct SN_env * z, const unsigned char * t, int repeat) {
+    return in_grouping_b_T_i(z, t, repeat);
+}
+
+extern int out_grouping_T(struct SN_env * z, const unsigned char * t, int repeat) {
+    return out_grouping_T_i(z, t, repeat);
+}
+
+extern int out_grouping_b_T(struct SN_env * z, const unsigned char * t, int repeat) {
+    return out_grouping_b_T_i(z, t, repeat);
+}
+
+/* In UTF-8 any byte below 0x80 is a whole character, so only the other
+ * characters need decoding and testing against the bitmap. */
+
+extern int in_grouping_TU(struct SN_env * z, const unsigned char * t, const unsigned char * s, int min, int max, int repeat) {
+    const symbol * p = z->p;
+    int c = z->c;
+    int l = z->l;
+    do {
+        int ch;
+        int w;
+        if (c >= l) {
+            z->c = c;
+            return -1;
+        }
+        ch = p[c];
+        if (ch < 0x80) {
+            if (!t[ch]) {
+                z->c = c;
+                return 1;
+            }
+            w = 1;
+        } else {
+            w = get_utf8(p, c, l, & ch);
+            if (ch > max || (ch -= min) < 0 || (s[ch >> 3] & (0X1 << (ch & 0X7))) == 0) {
+                z->c = c;
+                return w;
+            }
+        }
+        c += w;
+    } while (repeat);
+    z->c = c;
+    return 0;
+}
+
+extern int in_grouping_b_TU(struct SN_env * z, const unsigned char * t, const unsigned char * s, int min, int max, int repeat) {
+    const symbol * p = z->p;
+    int c = z->c;
+    int lb = z->lb;
+    do {
+        int ch;
+        int w;
+        if (c <= lb) {
+            z->c = c;
+            return -1;
+        }
+        ch = p[c - 1];
+        if (ch < 0x80) {
+            if (!t[ch]) {
+                z->c = c;
+                return 1;
+            }
+            w = 1;
+        } else {
+            w = get_b_utf8(p, c, lb, & ch);
+            if (ch > max || (ch -= min) < 0 || (s[ch >> 3] & (0X1 << (ch & 0X7))) == 0) {
+                z->c = c;
+                return w;
+            }
+        }
+        c -= w;
+    } while (repeat);
+    z->c = c;
+    return 0;
+}
+
+extern int out_grouping_TU(struct SN_env * z, const unsigned char * t, const unsigned char * s, int min, int max, int repeat) {
+    const symbol * p = z->p;
+    int c = z->c;
+    int l = z->l;
+    do {
+        int ch;
+        int w;
+        if (c >= l) {
+            z->c = c;
+            return -1;
+        }
+        ch = p[c];
+        if (ch < 0x80) {
+            if (t[ch]) {
+                z->c = c;
+                return 1;
+            }
+            w = 1;
+        } else {
+            w = get_utf8(p, c, l, & ch);
+            if (!(ch > max || (ch -= min) < 0 || (s[ch >> 3] & (0X1 << (ch & 0X7))) == 0)) {
+                z->c = c;
+                return w;
+            }
+        }
+        c += w;
+    } while (repeat);
+    z->c = c;
+    return 0;
+}
+
+extern int out_grouping_b_TU(struct SN_env * z, const unsigned char * t, const unsigned char * s, int min, int max, int repeat) {
+    const symbol * p = z->p;
+    int c = z->c;
+    int lb = z->lb;
+    do {
+        int ch;
+        int w;
+        if (c <= lb) {
+            z->c = c;
+            return -1;
+        }
+        ch = p[c - 1];
+        if (ch < 0x80) {
+            if (t[ch]) {
+                z->c = c;
+                return 1;
+            }
+            w = 1;
+        } else {
+            w = get_b_utf8(p, c, lb, & ch);
+            if (!(ch > max || (ch -= min) < 0 || (s[ch >> 3] & (0X1 << (ch & 0X7))) == 0)) {
+                z->c = c;
+                return w;
+            }
+        }
+        c -= w;
+    } while (repeat);
+    z->c = c;
+    return 0;
+}
+
 extern int eq_s(struct SN_env * z, int s_size, const symbol * s) {
-    if (z->l - z->c < s_size || memcmp(z->p + z->c, s, s_size * sizeof(symbol)) != 0) return 0;
-    z->c += s_size; return 1;
+    return eq_s_i(z, s_size, s);
 }
 
 extern int eq_s_b(struct SN_env * z, int s_size, const symbol * s) {
-    if (z->c - z->lb < s_size || memcmp(z->p + z->c - s_size, s, s_size * sizeof(symbol)) != 0) return 0;
-    z->c -= s_size; return 1;
+    return eq_s_b_i(z, s_size, s);
 }
 
 extern int eq_v(struct SN_env * z, const symbol * p) {
@@ -355,20 +500,267 @@ extern int find_among_b(struct SN_env * z, const struct among * v, int v_size,
     }
 }
 
+/* find_among_packed and find_among_packed_b are find_among and find_among_b
+ * for the tables generated by the -packed option, which refer to the search
+ * strings by offset in pool.
+ */
+
+extern int find_among_packed(struct SN_env * z, const struct among_packed * v,
+                             const symbol * pool, int v_size,
+                             int (*call_among_func)(struct SN_env*)) {
+
+    int i = 0;
+    int j = v_size;
+
+    int c = z->c; int l = z->l;
+    const symbol * q = z->p + c;
+
+    const struct among_packed * w;
+
+    int common_i = 0;
+    int common_j = 0;
+
+    int first_key_inspected = 0;
+
+    while (1) {
+        int k = i + ((j - i) >> 1);
+        int diff = 0;
+        int common = common_i < common_j ? common_i : common_j;
+        w = v + k;
+        {
+            const symbol * s = pool + w->s;
+            int i2; for (i2 = common; i2 < w->s_size; i2++) {
+                if (c + common == l) { diff = -1; break; }
+                diff = q[common] - s[i2];
+                if (diff != 0) break;
+                common++;
+            }
+        }
+        if (diff < 0) { j = k; common_j = common; }
+                 else { i = k; common_i = common; }
+        if (j - i <= 1) {
+            if (i > 0) break;
+            if (j == i) break;
+            if (first_key_inspected) break;
+            first_key_inspected = 1;
+        }
+    }
+    w = v + i;
+    while (1) {
+        if (common_i >= w->s_size) {
+            z->c = c + w->s_size;
+            if (!w->function) return w->result;
+            z->af = w->function;
+            if (call_among_func(z)) {
+                z->c = c + w->s_size;
+                return w->result;
+            }
+        }
+        if (!w->substring) return 0;
+        w = v + w->substring - 1;
+    }
+}
+
+extern int find_among_packed_b(struct SN_env * z,
+                               const struct among_packed * v,
+                               const symbol * pool, int v_size,
+                               int (*call_among_func)(struct SN_env*)) {
+
+    int i = 0;
+    int j = v_size;
+
+    int c = z->c; int lb = z->lb;
+    const symbol * q = z->p + c - 1;
+
+    const struct among_packed * w;
+
+    int common_i = 0;
+    int common_j = 0;
+
+    int first_key_inspected = 0;
+
+    while (1) {
+        int k = i + ((j - i) >> 1);
+        int diff = 0;
+        int common = common_i < common_j ? common_i : common_j;
+        w = v + k;
+        {
+            const symbol * s = pool + w->s;
+            int i2; for (i2 = w->s_size - 1 - common; i2 >= 0; i2--) {
+                if (c - common == lb) { diff = -1; break; }
+                diff = q[- common] - s[i2];
+                if (diff != 0) break;
+                common++;
+            }
+        }
+        if (diff < 0) { j = k; common_j = common; }
+                 else { i = k; common_i = common; }
+        if (j - i <= 1) {
+            if (i > 0) break;
+            if (j == i) break;
+            if (first_key_inspected) break;
+            first_key_inspected = 1;
+        }
+    }
+    w = v + i;
+    while (1) {
+        if (common_i >= w->s_size) {
+            z->c = c - w->s_size;
+            if (!w->function) return w->result;
+            z->af = w->function;
+            if (call_among_func(z)) {
+                z->c = c - w->s_size;
+                return w->result;
+            }
+        }
+        if (!w->substring) return 0;
+        w = v + w->substring - 1;
+    }
+}
+
+/* find_among_trie and find_among_trie_b give the same results as find_among
+ * and find_among_b, but find the longest matching string by walking a trie
+ * rather than by binary search.  Shorter matches are then tried via
+ * substring_i in the same way.
+ */
+
+extern int find_among_trie(struct SN_env * z, const struct among * v,
+                           const struct among_trie * t,
+                           int (*call_among_func)(struct SN_env*)) {
+    int c = z->c; int l = z->l;
+    const symbol * q = z->p;
+    int node = 0;
+    int e = t->entry[0];
+    int k;
+    const struct among * w;
+
+    for (k = c; k < l; k++) {
+        symbol ch = q[k];
+        int j = t->start[node];
+        int end = t->start[node + 1];
+        while (j < end && t->ch[j] < ch) j++;
+        if (j == end || t->ch[j] != ch) break;
+        node = j + 1;
+        if (t->entry[node]) e = t->entry[node];
+    }
+    if (!e) return 0;
+    w = v + e - 1;
+    while (1) {
+        z->c = c + w->s_size;
+        if (!w->function) return w->result;
+        z->af = w->function;
+        if (call_among_func(z)) {
+            z->c = c + w->s_size;
+            return w->result;
+        }
+        if (!w->substring_i) return 0;
+        w += w->substring_i;
+    }
+}
+
+extern int find_among_trie_b(struct SN_env * z, const struct among * v,
+                             const struct among_trie * t,
+                             int (*call_among_func)(struct SN_env*)) {
+    int c = z->c; int lb = z->lb;
+    const symbol * q = z->p;
+    int node = 0;
+    int e = t->entry[0];
+    int k;
+    const struct among * w;
+
+    for (k = c; k > lb; k--) {
+        symbol ch = q[k - 1];
+        int j = t->start[node];
+        int end = t->start[node + 1];
+        while (j < end && t->ch[j] < ch) j++;
+        if (j == end || t->ch[j] != ch) break;
+        node = j + 1;
+        if (t->entry[node]) e = t->entry[node];
+    }
+    if (!e) return 0;
+    w = v + e - 1;
+    while (1) {
+        z->c = c - w->s_size;
+        if (!w->function) return w->result;
+        z->af = w->function;
+        if (call_among_func(z)) {
+            z->c = c - w->s_size;
+            return w->result;
+        }
+        if (!w->substring_i) return 0;
+        w += w->substring_i;
+    }
+}
+
+/* find_among_p and find_among_b_p are used by code generated with -profile.
+ * They do the same as find_among and find_among_b, but also count the entry
+ * which matched in counts[] (or a miss in counts[v_size]).  The matched
+ * entry is the only one with the length matched which equals the text
+ * matched, since the strings in an among are distinct.
+ */
+
+static void count_among_entry(const struct SN_env * z, const struct among * v,
+                               int v_size, int start, int len,
+                               unsigned long * counts) {
+    int i;
+    for (i = 0; i < v_size; i++) {
+        if (v[i].s_size == len &&
+            memcmp(v[i].s, z->p + start, len * sizeof(symbol)) == 0) {
+            counts[i]++;
+            return;
+        }
+    }
+}
+
+extern int find_among_p(struct SN_env * z, const struct among * v, int v_size,
+                        int (*call_among_func)(struct SN_env*),
+                        unsigned long * counts) {
+    int c = z->c;
+    int result = find_among(z, v, v_size, call_among_func);
+    if (result) {
+        count_among_entry(z, v, v_size, c, z->c - c, counts);
+    } else {
+        counts[v_size]++;
+    }
+    return result;
+}
+
+extern int find_among_b_p(struct SN_env * z, const struct among * v, int v_size,
+                          int (*call_among_func)(struct SN_env*),
+                          unsigned long * counts) {
+    int c = z->c;
+    int result = find_among_b(z, v, v_size, call_among_func);
+    if (result) {
+        count_among_entry(z, v, v_size, z->c, c - z->c, counts);
+    } else {
+        counts[v_size]++;
+    }
+    return result;
+}
 
 /* Increase the size of the buffer pointed to by p to at least n symbols.
  * If insufficient memory, returns NULL and frees the old buffer.
+ * A buffer in an SN_env's arena is moved to the heap.
  */
-static symbol * increase_size(symbol * p, int n) {
+static symbol * increase_size(struct SN_env * z, symbol * p, int n) {
     symbol * q;
     int new_size = n + 20;
-    void * mem = realloc((char *) p - HEAD,
-                         HEAD + (new_size + 1) * sizeof(symbol));
-    if (mem == NULL) {
-        lose_s(p);
-        return NULL;
+    void * mem;
+    if (IN_ARENA(p)) {
+        mem = malloc(HEAD + (new_size + 1) * sizeof(symbol));
+        if (mem == NULL) return NULL;
+        memcpy(mem, (char *) p - HEAD, HEAD + SIZE(p) * sizeof(symbol));
+    } else {
+        mem = realloc((char *) p - HEAD,
+                      HEAD + (new_size + 1) * sizeof(symbol));
+        if (mem == NULL) {
+            lose_s(p);
+            return NULL;
+        }
     }
     q = (symbol *) (HEAD + (char *)mem);
+    ++z->reallocs;
+    IN_ARENA(q) = 0;
     CAPACITY(q) = new_size;
     return q;
 }
@@ -376,7 +768,8 @@ static symbol * increase_size(symbol * p, int n) {
 /* to replace symbols between c_bra and c_ket in z->p by the
    s_size symbols at s.
    Returns 0 on success, -1 on error.
-   Also, frees z->p (and sets it to NULL) on error.
+   Also, frees z->p (and sets it to NULL) on error, except when compiled with
+   SN_MAX_WORD_LENGTH where the only error is running out of room in z->p.
 */
 extern int replace_s(struct SN_env * z, int c_bra, int c_ket, int s_size, const symbol * s, int * adjptr)
 {
@@ -390,8 +783,13 @@ extern int replace_s(struct SN_env * z, int c_bra, int c_ket, int s_size, const
     len = SIZE(z->p);
     if (adjustment != 0) {
         if (adjustment + len > CAPACITY(z->p)) {
-            z->p = increase_size(z->p, adjustment + len);
+#ifdef SN_MAX_WORD_LENGTH
+            /* Buffers have a fixed size - fail, but leave z->p intact. */
+            return -1;
+#else
+            z->p = increase_size(z, z->p, adjustment + len);
             if (z->p == NULL) return -1;
+#endif
         }
         memmove(z->p + c_ket + adjustment,
                 z->p + c_ket,
@@ -460,7 +858,7 @@ extern symbol * slice_to(struct SN_env * z, symbol * p) {
     {
         int len = z->ket - z->bra;
         if (CAPACITY(p) < len) {
-            p = increase_size(p, len);
+            p = increase_size(z, p, len);
             if (p == NULL)
                 return NULL;
         }
@@ -473,7 +871,7 @@ extern symbol * slice_to(struct SN_env * z, symbol * p) {
 extern symbol * assign_to(struct SN_env * z, symbol * p) {
     int len = z->l;
     if (CAPACITY(p) < len) {
-        p = increase_size(p, len);
+        p = increase_size(z, p, len);
         if (p == NULL)
             return NULL;
     }
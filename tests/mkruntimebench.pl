@@ -0,0 +1,150 @@
+#!/usr/bin/env perl
+use strict;
+use 5.006;
+use warnings;
+
+# Write the sources which give runtimebench the among tables and groupings of
+# generated stemmers, so it times the runtime on exactly what the generator
+# emits.
+#
+#   mkruntimebench.pl <outfile> <generated .c file> <form>_<algorithm>
+#
+# writes a source which includes the generated stemmer and defines
+# runtimebench_<form>_<algorithm>, a struct bench_stemmer listing the tables
+# found in its calls to find_among and friends and the grouping tests.  An
+# among with condition routines is left out, since those need the stemmer's
+# own state.
+#
+#   mkruntimebench.pl -index <outfile> <form>_<algorithm>...
+#
+# writes the list of them, runtimebench_stemmers.
+
+my $progname = $0;
+
+sub usage()
+{
+    print "Usage: $progname <outfile> <generated .c file> <form>_<algorithm>\n";
+    print "       $progname -index <outfile> <form>_<algorithm>...\n";
+    exit 1;
+}
+
+usage() if scalar @ARGV < 2;
+
+sub readfile($)
+{
+    my $file = shift();
+    local $/;
+    open (IN, "<$file") or die "Can't open input file `$file': $!\n";
+    my $text = <IN>;
+    close IN;
+    return $text;
+}
+
+sub writefile($$)
+{
+    my $outname = shift();
+    my $text = shift();
+    open (OUT, ">$outname") or die "Can't open output file `$outname': $!\n";
+    print OUT $text;
+    close OUT or die "Can't close ${outname}: $!\n";
+}
+
+sub header($$)
+{
+    my $outname = shift();
+    my $from = shift();
+    return <<EOS;
+/* $outname: tables for runtimebench.
+ *
+ * This file is generated by mkruntimebench.pl from $from.
+ * Do not edit manually.
+ */
+
+EOS
+}
+
+if ($ARGV[0] eq '-index') {
+    shift(@ARGV);
+    my $outname = shift(@ARGV);
+    my $text = header($outname, 'the list of stemmers');
+    $text .= "#include \"../../runtime/header.h\"\n";
+    $text .= "#include \"../../tests/runtimebench.h\"\n\n";
+    foreach my $name (@ARGV) {
+        $text .= "extern const struct bench_stemmer runtimebench_$name;\n";
+    }
+    $text .= "\nconst struct bench_stemmer * const runtimebench_stemmers[] = {\n";
+    foreach my $name (@ARGV) {
+        $text .= "    &runtimebench_$name,\n";
+    }
+    $text .= "    0\n};\n";
+    writefile($outname, $text);
+    exit 0;
+}
+
+usage() if scalar @ARGV != 3;
+my ($outname, $srcfile, $name) = @ARGV;
+$name =~ m/^([A-Za-z0-9]+)_(\w+)$/ or die "Can't split `$name' into form and algorithm\n";
+my ($form, $algorithm) = ($1, $2);
+
+my $src = readfile($srcfile);
+my $include = $srcfile;
+$include =~ s!.*/!!;
+
+my %sizes = ();
+while ($src =~ m/^static const struct among(?:_packed)? (a_\d+)\[(\d+)\]/mg) {
+    $sizes{$1} = $2;
+}
+
+# Each table in the order of its first use.
+my @amongs = ();
+my %seen = ();
+while ($src =~ m/\bfind_among(_trie|_packed)?(_b)?\(z, (a_\d+), ([^;]*?)\)/g) {
+    my ($kind, $backward, $table, $args) = ($1 || '', $2 ? 1 : 0, $3, $4);
+    next if $seen{$table}++;
+    my @args = split(/, /, $args);
+    next if $args[-1] ne '0';
+    my %among = (name => $table, backward => $backward,
+                 size => $sizes{$table}, v => '0', trie => '0',
+                 packed => '0', pool => '0');
+    defined $among{size} or die "$srcfile: can't find the size of $table\n";
+    if ($kind eq '_packed') {
+        $among{packed} = $table;
+        $among{pool} = $args[0];
+    } else {
+        $among{v} = $table;
+        $among{trie} = $args[0] if $kind eq '_trie';
+    }
+    push @amongs, \%among;
+}
+
+# The groupings, with the limits of the bitmap from the calls which use it.
+my @groupings = ();
+while ($src =~ m/^static const unsigned char gt_(\w+)\[(\d+)\]/mg) {
+    my $g = $1;
+    my %grouping = (name => $g, lookup_size => $2,
+                    bitmap => '0', min => 0, max => 0);
+    if ($src =~ m/grouping\w*\(z, gt_$g, g_$g, (\d+), (\d+)/) {
+        $grouping{bitmap} = "g_$g";
+        $grouping{min} = $1;
+        $grouping{max} = $2;
+    }
+    push @groupings, \%grouping;
+}
+
+my $text = header($outname, $srcfile);
+$text .= "#include \"$include\"\n";
+$text .= "#include \"../../tests/runtimebench.h\"\n\n";
+$text .= "static const struct bench_among bench_amongs[] = {\n";
+foreach my $x (@amongs) {
+    $text .= "    { \"$$x{name}\", $$x{backward}, $$x{size}, $$x{v}, $$x{trie}, $$x{packed}, $$x{pool} },\n";
+}
+$text .= "    { 0, 0, 0, 0, 0, 0, 0 }\n};\n\n";
+$text .= "static const struct bench_grouping bench_groupings[] = {\n";
+foreach my $x (@groupings) {
+    $text .= "    { \"$$x{name}\", gt_$$x{name}, $$x{lookup_size}, $$x{bitmap}, $$x{min}, $$x{max} },\n";
+}
+$text .= "    { 0, 0, 0, 0, 0, 0 }\n};\n\n";
+$text .= "extern const struct bench_stemmer runtimebench_$name;\n\n";
+$text .= "const struct bench_stemmer runtimebench_$name = {\n";
+$text .= "    \"$algorithm\", \"$form\", bench_amongs, bench_groupings\n};\n";
+writefile($outname, $text);
@@ -0,0 +1,913 @@
+/* Microbenchmarks for the runtime support routines in runtime/utilities.c.
+ *
+ * Each primitive is called in isolation over a list of words, either read
+ * from a file (one per line, as for stemwords) or generated, and the time
+ * per call is reported.  The among lookups are run over the tables of
+ * stemmers generated with -trie and with -packed (see runtimebench.h), so
+ * each table is timed in each of the forms the generator emits, and the
+ * grouping tests use the english stemmer's grouping v.  The grouping tests
+ * are run both as out-of-line calls and in the inline forms from header.h
+ * which -inline uses.
+ */
+
+#include <stdio.h>
+#include <stdlib.h> /* for malloc, free, qsort */
+#include <string.h> /* for strcmp, memchr, memcpy */
+#include <time.h>
+
+#if defined __unix__ || defined __unix || (defined __APPLE__ && defined __MACH__)
+# include <unistd.h>
+# if defined _POSIX_TIMERS && _POSIX_TIMERS > 0 && defined CLOCK_MONOTONIC
+#  define HAVE_CLOCK_GETTIME 1
+# endif
+#endif
+
+#if defined __GNUC__ && (defined __x86_64__ || defined __i386__)
+# include <x86intrin.h>
+# define HAVE_RDTSC 1
+#endif
+
+#include "../runtime/header.h"
+#include "runtimebench.h"
+
+const char * progname;
+
+/* Number of generated words if no input file is given. */
+#define N_GENERATED_WORDS 20000
+
+struct word {
+    const symbol * s;
+    int len;
+};
+
+struct word_list {
+    symbol * text;
+    struct word * words;
+    int count;
+};
+
+/* An among table with the forms of it which were generated. */
+struct table {
+    /* The algorithm and the table's name, e.g. "english a_7". */
+    char name[40];
+    int backward;
+    int size;
+    const struct among * v;
+    /* Null if the table was too big for a trie. */
+    const struct among_trie * trie;
+    /* Null if the table couldn't be packed. */
+    const struct among_packed * packed;
+    const symbol * pool;
+};
+
+/* Everything a benchmark loop needs. */
+struct bench {
+    /* Environment for primitives which only read the word, which is pointed
+     * at the word list rather than copied. */
+    struct SN_env * z;
+    /* Environment for primitives which modify the word. */
+    struct SN_env * zw;
+    const struct word_list * words;
+    const struct table * table;
+    /* The grouping v as generated for UTF-8, for the _U and _TU functions,
+     * and for a single byte encoding, for the _T ones. */
+    const struct bench_grouping * g_U;
+    const struct bench_grouping * g_T;
+    symbol * buf;
+    int dummy;
+};
+
+typedef void (*bench_loop)(struct bench * b);
+
+static double min_seconds = 0.2;
+
+static void
+out_of_memory(void)
+{
+    fprintf(stderr, "Out of memory or internal error\n");
+    exit(1);
+}
+
+static double
+now_ns(void)
+{
+#ifdef HAVE_CLOCK_GETTIME
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+#else
+    return clock() * (1e9 / CLOCKS_PER_SEC);
+#endif
+}
+
+static unsigned long long
+now_cycles(void)
+{
+#ifdef HAVE_RDTSC
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+/* A simple deterministic pseudo-random number generator, so that the
+ * generated data is the same on every run. */
+static unsigned long rng_state = 12345;
+
+static int
+rng(int n)
+{
+    rng_state = rng_state * 1103515245 + 12345;
+    return (int)((rng_state >> 16) % (unsigned long)n);
+}
+
+static void
+read_words(FILE * f_in, struct word_list * list)
+{
+    size_t size = 1 << 16;
+    size_t len = 0;
+    int n_lines = 0;
+    size_t i;
+    symbol * text = (symbol *) malloc(size);
+    if (text == NULL) out_of_memory();
+
+    while (1) {
+        size_t got;
+        if (len == size) {
+            symbol * new_text;
+            size *= 2;
+            new_text = (symbol *) realloc(text, size);
+            if (new_text == NULL) out_of_memory();
+            text = new_text;
+        }
+        got = fread(text + len, 1, size - len, f_in);
+        if (got == 0) break;
+        len += got;
+    }
+    for (i = 0; i < len; i++) {
+        if (text[i] == '\n') ++n_lines;
+    }
+    list->words = (struct word *) malloc((n_lines + 1) * sizeof(struct word));
+    if (list->words == NULL) out_of_memory();
+    list->count = 0;
+    i = 0;
+    while (i < len) {
+        const symbol * nl = (const symbol *) memchr(text + i, '\n', len - i);
+        size_t end = nl ? (size_t)(nl - text) : len;
+        if (end > i) {
+            list->words[list->count].s = text + i;
+            list->words[list->count].len = (int)(end - i);
+            ++list->count;
+        }
+        i = end + 1;
+    }
+    list->text = text;
+}
+
+/* Gather the tables of the generated stemmers, pairing the -trie and -packed
+ * forms of each. */
+static struct table *
+collect_tables(int * count)
+{
+    const struct bench_stemmer * const * p;
+    struct table * tables;
+    int n = 0;
+    int i;
+
+    for (p = runtimebench_stemmers; *p; p++) {
+        const struct bench_among * x;
+        for (x = (*p)->amongs; x->name; x++) ++n;
+    }
+    tables = (struct table *) malloc(n * sizeof(struct table));
+    if (tables == NULL) out_of_memory();
+
+    n = 0;
+    for (p = runtimebench_stemmers; *p; p++) {
+        const struct bench_among * x;
+        if (strcmp((*p)->form, "trie") != 0) continue;
+        for (x = (*p)->amongs; x->name; x++) {
+            struct table * t = &tables[n++];
+            sprintf(t->name, "%.20s %.12s", (*p)->algorithm, x->name);
+            t->backward = x->backward;
+            t->size = x->size;
+            t->v = x->v;
+            t->trie = x->trie;
+            t->packed = NULL;
+            t->pool = NULL;
+        }
+    }
+    for (p = runtimebench_stemmers; *p; p++) {
+        const struct bench_among * x;
+        if (strcmp((*p)->form, "packed") != 0) continue;
+        for (x = (*p)->amongs; x->name; x++) {
+            char name[40];
+            sprintf(name, "%.20s %.12s", (*p)->algorithm, x->name);
+            for (i = 0; i < n; i++) {
+                if (strcmp(tables[i].name, name) == 0) break;
+            }
+            if (i == n) {
+                fprintf(stderr, "%s was only generated with -packed\n", name);
+                exit(1);
+            }
+            tables[i].packed = x->packed;
+            tables[i].pool = x->pool;
+        }
+    }
+    *count = n;
+    return tables;
+}
+
+/* Order tables forward then backward, each by size. */
+static int
+compare_tables(const void * a, const void * b)
+{
+    const struct table * x = (const struct table *)a;
+    const struct table * y = (const struct table *)b;
+    if (x->backward != y->backward) return x->backward - y->backward;
+    if (x->size != y->size) return x->size - y->size;
+    return strcmp(x->name, y->name);
+}
+
+static const struct bench_grouping *
+find_grouping(const char * algorithm, const char * form, const char * name)
+{
+    const struct bench_stemmer * const * p;
+    for (p = runtimebench_stemmers; *p; p++) {
+        const struct bench_grouping * g;
+        if (strcmp((*p)->algorithm, algorithm) != 0 ||
+            strcmp((*p)->form, form) != 0) {
+            continue;
+        }
+        for (g = (*p)->groupings; g->name; g++) {
+            if (strcmp(g->name, name) == 0) return g;
+        }
+    }
+    fprintf(stderr, "grouping %s not found in the %s %s stemmer\n",
+            name, form, algorithm);
+    exit(1);
+}
+
+/* Generate lower case words, some with a prefix or suffix from a forward or
+ * backward among table and some containing a non-ASCII character, so both
+ * the matching and non-matching paths get exercised. */
+static void
+generate_words(struct word_list * list, const struct table * tables,
+               int n_tables)
+{
+    static const char letters[] = "abcdefghiklmnoprstuvwy";
+    int longest = 0;
+    int max_len;
+    int i;
+    symbol * p;
+    for (i = 0; i < n_tables; i++) {
+        int j;
+        for (j = 0; j < tables[i].size; j++) {
+            if (tables[i].v[j].s_size > longest) longest = tables[i].v[j].s_size;
+        }
+    }
+    max_len = longest + 12 + longest;
+    list->text = (symbol *) malloc(N_GENERATED_WORDS * max_len);
+    list->words = (struct word *) malloc(N_GENERATED_WORDS * sizeof(struct word));
+    if (list->text == NULL || list->words == NULL) out_of_memory();
+    p = list->text;
+    for (i = 0; i < N_GENERATED_WORDS; i++) {
+        int len = 3 + rng(10);
+        const struct among * w = NULL;
+        int j;
+        list->words[i].s = p;
+        if (rng(2) && n_tables) {
+            const struct table * t = &tables[rng(n_tables)];
+            w = &t->v[rng(t->size)];
+            if (!t->backward) {
+                memcpy(p, w->s, w->s_size);
+                p += w->s_size;
+                w = NULL;
+            }
+        }
+        for (j = 0; j < len; j++) *p++ = letters[rng(sizeof(letters) - 1)];
+        if (rng(10) == 0) {
+            /* e-acute in UTF-8 */
+            p[-2] = 0xC3;
+            p[-1] = 0xA9;
+        }
+        if (w) {
+            memcpy(p, w->s, w->s_size);
+            p += w->s_size;
+        }
+        list->words[i].len = (int)(p - list->words[i].s);
+    }
+    list->count = N_GENERATED_WORDS;
+}
+
+/* Point z at word w without copying it, for primitives which only read. */
+static void
+set_word(struct SN_env * z, const struct word * w)
+{
+    z->p = (symbol *) w->s;
+    z->l = w->len;
+    z->lb = 0;
+}
+
+/* The benchmark loops.  Each calls one primitive once per word. */
+
+static void
+loop_overhead(struct bench * b)
+{
+    const struct word_list * list = b->words;
+    int i;
+    for (i = 0; i < list->count; i++) {
+        set_word(b->z, &list->words[i]);
+        b->z->c = b->z->l;
+        b->dummy += b->z->c;
+    }
+}
+
+static void
+loop_find_among(struct bench * b)
+{
+    const struct word_list * list = b->words;
+    int i;
+    for (i = 0; i < list->count; i++) {
+        set_word(b->z, &list->words[i]);
+        b->z->c = 0;
+        b->dummy += find_among(b->z, b->table->v, b->table->size, 0);
+    }
+}
+
+static void
+loop_find_among_b(struct bench * b)
+{
+    const struct word_list * list = b->words;
+    int i;
+    for (i = 0; i < list->count; i++) {
+        set_word(b->z, &list->words[i]);
+        b->z->c = b->z->l;
+        b->dummy += find_among_b(b->z, b->table->v, b->table->size, 0);
+    }
+}
+
+static void
+loop_find_among_trie(struct bench * b)
+{
+    const struct word_list * list = b->words;
+    int i;
+    for (i = 0; i < list->count; i++) {
+        set_word(b->z, &list->words[i]);
+        b->z->c = 0;
+        b->dummy += find_among_trie(b->z, b->table->v, b->table->trie, 0);
+    }
+}
+
+static void
+loop_find_among_trie_b(struct bench * b)
+{
+    const struct word_list * list = b->words;
+    int i;
+    for (i = 0; i < list->count; i++) {
+        set_word(b->z, &list->words[i]);
+        b->z->c = b->z->l;
+        b->dummy += find_among_trie_b(b->z, b->table->v, b->table->trie, 0);
+    }
+}
+
+static void
+loop_find_among_packed(struct bench * b)
+{
+    const struct word_list * list = b->words;
+    int i;
+    for (i = 0; i < list->count; i++) {
+        set_word(b->z, &list->words[i]);
+        b->z->c = 0;
+        b->dummy += find_among_packed(b->z, b->table->packed, b->table->pool,
+                                      b->table->size, 0);
+    }
+}
+
+static void
+loop_find_among_packed_b(struct bench * b)
+{
+    const struct word_list * list = b->words;
+    int i;
+    for (i = 0; i < list->count; i++) {
+        set_word(b->z, &list->words[i]);
+        b->z->c = b->z->l;
+        b->dummy += find_among_packed_b(b->z, b->table->packed, b->table->pool,
+                                        b->table->size, 0);
+    }
+}
+
+static void
+loop_in_grouping_U(struct bench * b)
+{
+    const struct word_list * list = b->words;
+    int i;
+    for (i = 0; i < list->count; i++) {
+        set_word(b->z, &list->words[i]);
+        b->z->c = 0;
+        b->dummy += in_grouping_U(b->z, b->g_U->bitmap, b->g_U->min, b->g_U->max, 0);
+    }
+}
+
+/* As used by "gopast v": skip forwards over non-vowels. */
+static void
+loop_out_grouping_U_repeat(struct bench * b)
+{
+    const struct word_list * list = b->words;
+    int i;
+    for (i = 0; i < list->count; i++) {
+        set_word(b->z, &list->words[i]);
+        b->z->c = 0;
+        b->dummy += out_grouping_U(b->z, b->g_U->bitmap, b->g_U->min, b->g_U->max, 1);
+    }
+}
+
+static void
+loop_out_grouping_b_U(struct bench * b)
+{
+    const struct word_list * list = b->words;
+    int i;
+    for (i = 0; i < list->count; i++) {
+        set_word(b->z, &list->words[i]);
+        b->z->c = b->z->l;
+        b->dummy += out_grouping_b_U(b->z, b->g_U->bitmap, b->g_U->min, b->g_U->max, 0);
+    }
+}
+
+static void
+loop_out_grouping_b_U_repeat(struct bench * b)
+{
+    const struct word_list * list = b->words;
+    int i;
+    for (i = 0; i < list->count; i++) {
+        set_word(b->z, &list->words[i]);
+        b->z->c = b->z->l;
+        b->dummy += out_grouping_b_U(b->z, b->g_U->bitmap, b->g_U->min, b->g_U->max, 1);
+    }
+}
+
+/* The lookup table forms of the grouping tests above, out of line and
+ * inline. */
+
+static void
+loop_in_grouping_TU(struct bench * b)
+{
+    const struct word_list * list = b->words;
+    int i;
+    for (i = 0; i < list->count; i++) {
+        set_word(b->z, &list->words[i]);
+        b->z->c = 0;
+        b->dummy += in_grouping_TU(b->z, b->g_U->lookup, b->g_U->bitmap,
+                                   b->g_U->min, b->g_U->max, 0);
+    }
+}
+
+static void
+loop_in_grouping_TU_i(struct bench * b)
+{
+    const struct word_list * list = b->words;
+    int i;
+    for (i = 0; i < list->count; i++) {
+        set_word(b->z, &list->words[i]);
+        b->z->c = 0;
+        b->dummy += in_grouping_TU_i(b->z, b->g_U->lookup, b->g_U->bitmap,
+                                     b->g_U->min, b->g_U->max, 0);
+    }
+}
+
+static void
+loop_out_grouping_TU_repeat(struct bench * b)
+{
+    const struct word_list * list = b->words;
+    int i;
+    for (i = 0; i < list->count; i++) {
+        set_word(b->z, &list->words[i]);
+        b->z->c = 0;
+        b->dummy += out_grouping_TU(b->z, b->g_U->lookup, b->g_U->bitmap,
+                                    b->g_U->min, b->g_U->max, 1);
+    }
+}
+
+static void
+loop_out_grouping_TU_i_repeat(struct bench * b)
+{
+    const struct word_list * list = b->words;
+    int i;
+    for (i = 0; i < list->count; i++) {
+        set_word(b->z, &list->words[i]);
+        b->z->c = 0;
+        b->dummy += out_grouping_TU_i(b->z, b->g_U->lookup, b->g_U->bitmap,
+                                      b->g_U->min, b->g_U->max, 1);
+    }
+}
+
+static void
+loop_out_grouping_b_TU_repeat(struct bench * b)
+{
+    const struct word_list * list = b->words;
+    int i;
+    for (i = 0; i < list->count; i++) {
+        set_word(b->z, &list->words[i]);
+        b->z->c = b->z->l;
+        b->dummy += out_grouping_b_TU(b->z, b->g_U->lookup, b->g_U->bitmap,
+                                      b->g_U->min, b->g_U->max, 1);
+    }
+}
+
+static void
+loop_out_grouping_b_TU_i_repeat(struct bench * b)
+{
+    const struct word_list * list = b->words;
+    int i;
+    for (i = 0; i < list->count; i++) {
+        set_word(b->z, &list->words[i]);
+        b->z->c = b->z->l;
+        b->dummy += out_grouping_b_TU_i(b->z, b->g_U->lookup, b->g_U->bitmap,
+                                        b->g_U->min, b->g_U->max, 1);
+    }
+}
+
+/* As used by single-byte stemmers (the UTF-8 words just have more bytes which
+ * aren't in the grouping). */
+static void
+loop_in_grouping_T(struct bench * b)
+{
+    const struct word_list * list = b->words;
+    int i;
+    for (i = 0; i < list->count; i++) {
+        set_word(b->z, &list->words[i]);
+        b->z->c = 0;
+        b->dummy += in_grouping_T(b->z, b->g_T->lookup, 0);
+    }
+}
+
+static void
+loop_in_grouping_T_i(struct bench * b)
+{
+    const struct word_list * list = b->words;
+    int i;
+    for (i = 0; i < list->count; i++) {
+        set_word(b->z, &list->words[i]);
+        b->z->c = 0;
+        b->dummy += in_grouping_T_i(b->z, b->g_T->lookup, 0);
+    }
+}
+
+static void
+loop_out_grouping_b_T_repeat(struct bench * b)
+{
+    const struct word_list * list = b->words;
+    int i;
+    for (i = 0; i < list->count; i++) {
+        set_word(b->z, &list->words[i]);
+        b->z->c = b->z->l;
+        b->dummy += out_grouping_b_T(b->z, b->g_T->lookup, 1);
+    }
+}
+
+static void
+loop_out_grouping_b_T_i_repeat(struct bench * b)
+{
+    const struct word_list * list = b->words;
+    int i;
+    for (i = 0; i < list->count; i++) {
+        set_word(b->z, &list->words[i]);
+        b->z->c = b->z->l;
+        b->dummy += out_grouping_b_T_i(b->z, b->g_T->lookup, 1);
+    }
+}
+
+static void
+loop_skip_utf8(struct bench * b)
+{
+    const struct word_list * list = b->words;
+    int i;
+    for (i = 0; i < list->count; i++) {
+        const struct word * w = &list->words[i];
+        b->dummy += skip_utf8(w->s, 0, w->len, 2);
+    }
+}
+
+static void
+loop_skip_b_utf8(struct bench * b)
+{
+    const struct word_list * list = b->words;
+    int i;
+    for (i = 0; i < list->count; i++) {
+        const struct word * w = &list->words[i];
+        b->dummy += skip_b_utf8(w->s, w->len, 0, 2);
+    }
+}
+
+static void
+loop_eq_s_b(struct bench * b)
+{
+    static const symbol s_ing[] = { 'i', 'n', 'g' };
+    const struct word_list * list = b->words;
+    int i;
+    for (i = 0; i < list->count; i++) {
+        set_word(b->z, &list->words[i]);
+        b->z->c = b->z->l;
+        b->dummy += eq_s_b(b->z, 3, s_ing);
+    }
+}
+
+static void
+loop_eq_s_b_i(struct bench * b)
+{
+    static const symbol s_ing[] = { 'i', 'n', 'g' };
+    const struct word_list * list = b->words;
+    int i;
+    for (i = 0; i < list->count; i++) {
+        set_word(b->z, &list->words[i]);
+        b->z->c = b->z->l;
+        b->dummy += eq_s_b_i(b->z, 3, s_ing);
+    }
+}
+
+/* slice_to and replace_s need the word in a buffer allocated by the
+ * runtime, so these include the cost of SN_set_current, which is measured
+ * on its own for comparison. */
+
+static void
+loop_set_current(struct bench * b)
+{
+    const struct word_list * list = b->words;
+    int i;
+    for (i = 0; i < list->count; i++) {
+        const struct word * w = &list->words[i];
+        if (SN_set_current(b->zw, w->len, w->s) < 0) out_of_memory();
+    }
+}
+
+static void
+loop_slice_to(struct bench * b)
+{
+    const struct word_list * list = b->words;
+    int i;
+    for (i = 0; i < list->count; i++) {
+        const struct word * w = &list->words[i];
+        if (SN_set_current(b->zw, w->len, w->s) < 0) out_of_memory();
+        b->zw->bra = 0;
+        b->zw->ket = b->zw->l;
+        b->buf = slice_to(b->zw, b->buf);
+        if (b->buf == NULL) out_of_memory();
+    }
+}
+
+/* Replace the last two bytes (if there are two) with "ee". */
+static void
+loop_replace_s(struct bench * b)
+{
+    static const symbol s_ee[] = { 'e', 'e' };
+    const struct word_list * list = b->words;
+    int i;
+    for (i = 0; i < list->count; i++) {
+        const struct word * w = &list->words[i];
+        if (SN_set_current(b->zw, w->len, w->s) < 0) out_of_memory();
+        if (w->len >= 2 &&
+            replace_s(b->zw, w->len - 2, w->len, 2, s_ee, NULL) < 0) {
+            out_of_memory();
+        }
+    }
+}
+
+/* Check the trie and packed forms of t give the same results as the plain
+ * table for every word, so they're timing the same work. */
+static void
+check_table(struct bench * b, const struct table * t)
+{
+    const struct word_list * list = b->words;
+    int i, k;
+    for (i = 0; i < list->count; i++) {
+        int start, result, c;
+        set_word(b->z, &list->words[i]);
+        start = t->backward ? b->z->l : 0;
+        b->z->c = start;
+        result = t->backward ? find_among_b(b->z, t->v, t->size, 0)
+                             : find_among(b->z, t->v, t->size, 0);
+        c = b->z->c;
+        for (k = 0; k < 2; k++) {
+            int r;
+            if (k == 0 ? !t->trie : !t->packed) continue;
+            b->z->c = start;
+            if (k == 0) {
+                r = t->backward ? find_among_trie_b(b->z, t->v, t->trie, 0)
+                                : find_among_trie(b->z, t->v, t->trie, 0);
+            } else {
+                r = t->backward
+                    ? find_among_packed_b(b->z, t->packed, t->pool, t->size, 0)
+                    : find_among_packed(b->z, t->packed, t->pool, t->size, 0);
+            }
+            if (r != result || (result && b->z->c != c)) {
+                fprintf(stderr, "%s: %s lookup of %.*s differs\n", t->name,
+                        k == 0 ? "trie" : "packed",
+                        list->words[i].len, (const char *)list->words[i].s);
+                exit(1);
+            }
+        }
+    }
+}
+
+/* Run loop repeatedly for at least min_seconds and report the time per
+ * call. */
+static void
+run(const char * primitive, const char * table, int size, bench_loop loop,
+    struct bench * b)
+{
+    double t0, elapsed;
+    unsigned long long c0, cycles;
+    double calls;
+    long passes = 0;
+
+    /* Warm up. */
+    loop(b);
+
+    t0 = now_ns();
+    c0 = now_cycles();
+    do {
+        loop(b);
+        ++passes;
+        elapsed = now_ns() - t0;
+    } while (elapsed < min_seconds * 1e9);
+    cycles = now_cycles() - c0;
+
+    calls = (double)b->words->count * passes;
+    printf("%-26s %-18s", primitive, table);
+    if (size) {
+        printf(" %5d", size);
+    } else {
+        printf(" %5s", "");
+    }
+    printf(" %12.0f %9.2f", calls, elapsed / calls);
+#ifdef HAVE_RDTSC
+    printf(" %11.2f", cycles / calls);
+#else
+    (void)cycles;
+    printf(" %11s", "-");
+#endif
+    printf("\n");
+}
+
+static void
+usage(int n)
+{
+    printf("usage: %s [-i <input file>] [-t <seconds>] [-h]\n"
+          "\n"
+          "Measures the time per call of the runtime support routines used by\n"
+          "the generated C stemmers.\n"
+          "\n"
+          "The input file consists of a list of UTF-8 words, one per line.  If\n"
+          "omitted, %d words are generated.\n"
+          "\n"
+          "-t gives the minimum number of seconds to spend on each measurement\n"
+          "(default 0.2).\n"
+          "\n"
+          "Cycles are timestamp counter ticks, and are only reported on x86.\n"
+          "\n"
+          "-h displays this help\n",
+          progname, N_GENERATED_WORDS);
+    exit(n);
+}
+
+int
+main(int argc, char * argv[])
+{
+    const char * in = NULL;
+    struct word_list words;
+    struct bench b;
+    struct table * tables;
+    int n_tables;
+    symbol * z_p;
+    int i = 1;
+
+    progname = argv[0];
+
+    while (i < argc) {
+        const char * s = argv[i++];
+        if (s[0] == '-') {
+            if (strcmp(s, "-i") == 0) {
+                if (i >= argc) {
+                    fprintf(stderr, "%s requires an argument\n", s);
+                    exit(1);
+                }
+                in = argv[i++];
+            } else if (strcmp(s, "-t") == 0) {
+                if (i >= argc) {
+                    fprintf(stderr, "%s requires an argument\n", s);
+                    exit(1);
+                }
+                min_seconds = atof(argv[i++]);
+                if (!(min_seconds > 0)) {
+                    fprintf(stderr, "-t requires a positive number of seconds\n");
+                    exit(1);
+                }
+            } else if (strcmp(s, "-h") == 0) {
+                usage(0);
+            } else {
+                fprintf(stderr, "option %s unknown\n", s);
+                usage(1);
+            }
+        } else {
+            fprintf(stderr, "unexpected parameter %s\n", s);
+            usage(1);
+        }
+    }
+
+    tables = collect_tables(&n_tables);
+    qsort(tables, n_tables, sizeof(struct table), compare_tables);
+
+    if (in) {
+        FILE * f_in = fopen(in, "rb");
+        if (f_in == NULL) {
+            fprintf(stderr, "file %s not found\n", in);
+            exit(1);
+        }
+        read_words(f_in, &words);
+        fclose(f_in);
+        if (words.count == 0) {
+            fprintf(stderr, "no words in %s\n", in);
+            exit(1);
+        }
+    } else {
+        generate_words(&words, tables, n_tables);
+    }
+
+    b.z = SN_create_env(0, 0);
+    b.zw = SN_create_env(0, 0);
+    if (b.z == NULL || b.zw == NULL) out_of_memory();
+    z_p = b.z->p;
+    b.words = &words;
+    b.table = NULL;
+    b.g_U = find_grouping("english", "trie", "v");
+    b.g_T = find_grouping("english", "8bit", "v");
+    if (b.g_U->bitmap == NULL || b.g_U->lookup_size != 128 ||
+        b.g_T->lookup_size != 256) {
+        fprintf(stderr, "grouping v isn't in the expected forms\n");
+        exit(1);
+    }
+    b.buf = create_s();
+    if (b.buf == NULL) out_of_memory();
+    b.dummy = 0;
+
+    for (i = 0; i < n_tables; i++) check_table(&b, &tables[i]);
+
+    printf("%d words from %s\n\n", words.count, in ? in : "generator");
+    printf("%-26s %-18s %5s %12s %9s %11s\n",
+           "primitive", "table", "size", "calls", "ns/call", "cycles/call");
+
+    run("(loop overhead)", "", 0, loop_overhead, &b);
+    for (i = 0; i < n_tables; i++) {
+        b.table = &tables[i];
+        if (b.table->backward) {
+            run("find_among_b", b.table->name, b.table->size, loop_find_among_b, &b);
+            if (b.table->trie) {
+                run("find_among_trie_b", b.table->name, b.table->size, loop_find_among_trie_b, &b);
+            }
+            if (b.table->packed) {
+                run("find_among_packed_b", b.table->name, b.table->size, loop_find_among_packed_b, &b);
+            }
+        } else {
+            run("find_among", b.table->name, b.table->size, loop_find_among, &b);
+            if (b.table->trie) {
+                run("find_among_trie", b.table->name, b.table->size, loop_find_among_trie, &b);
+            }
+            if (b.table->packed) {
+                run("find_among_packed", b.table->name, b.table->size, loop_find_among_packed, &b);
+            }
+        }
+    }
+    run("in_grouping_U", "english v", 0, loop_in_grouping_U, &b);
+    run("in_grouping_TU", "english v", 0, loop_in_grouping_TU, &b);
+    run("in_grouping_TU_i", "english v", 0, loop_in_grouping_TU_i, &b);
+    run("out_grouping_U repeat", "english v", 0, loop_out_grouping_U_repeat, &b);
+    run("out_grouping_TU repeat", "english v", 0, loop_out_grouping_TU_repeat, &b);
+    run("out_grouping_TU_i repeat", "english v", 0, loop_out_grouping_TU_i_repeat, &b);
+    run("out_grouping_b_U", "english v", 0, loop_out_grouping_b_U, &b);
+    run("out_grouping_b_U repeat", "english v", 0, loop_out_grouping_b_U_repeat, &b);
+    run("out_grouping_b_TU repeat", "english v", 0, loop_out_grouping_b_TU_repeat, &b);
+    run("out_grouping_b_TU_i repeat", "english v", 0, loop_out_grouping_b_TU_i_repeat, &b);
+    run("in_grouping_T", "english v", 0, loop_in_grouping_T, &b);
+    run("in_grouping_T_i", "english v", 0, loop_in_grouping_T_i, &b);
+    run("out_grouping_b_T repeat", "english v", 0, loop_out_grouping_b_T_repeat, &b);
+    run("out_grouping_b_T_i repeat", "english v", 0, loop_out_grouping_b_T_i_repeat, &b);
+    run("skip_utf8 (hop 2)", "", 0, loop_skip_utf8, &b);
+    run("skip_b_utf8 (hop 2)", "", 0, loop_skip_b_utf8, &b);
+    run("eq_s_b (\"ing\")", "", 0, loop_eq_s_b, &b);
+    run("eq_s_b_i (\"ing\")", "", 0, loop_eq_s_b_i, &b);
+    run("SN_set_current", "", 0, loop_set_current, &b);
+    run("SN_set_current+slice_to", "", 0, loop_slice_to, &b);
+    run("SN_set_current+replace_s", "", 0, loop_replace_s, &b);
+
+    /* Stop the compiler optimising away the results. */
+    if (b.dummy == 42) printf("\n");
+
+    lose_s(b.buf);
+    /* b.z->p now points into the word list. */
+    b.z->p = z_p;
+    SN_close_env(b.z, 0);
+    SN_close_env(b.zw, 0);
+    free(tables);
+    free(words.words);
+    free(words.text);
+    return 0;
+}
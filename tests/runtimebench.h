@@ -0,0 +1,45 @@
+/* Tables of generated stemmers for runtimebench.  The sources which define
+ * these are written by tests/mkruntimebench.pl from stemmers generated in the
+ * forms listed in the GNUmakefile.
+ *
+ * runtime/header.h must be included first.
+ */
+
+/* An among table, in the forms it was generated in (the others are null). */
+struct bench_among {
+    /* Its name in the generated code, e.g. "a_7". */
+    const char * name;
+    int backward;
+    int size;
+    const struct among * v;
+    /* With -trie. */
+    const struct among_trie * trie;
+    /* With -packed. */
+    const struct among_packed * packed;
+    const symbol * pool;
+};
+
+struct bench_grouping {
+    /* Its name in the Snowball source, e.g. "v". */
+    const char * name;
+    /* One entry per ASCII character for UTF-8, or per byte otherwise. */
+    const unsigned char * lookup;
+    int lookup_size;
+    /* The bitmap of the characters from min to max (UTF-8 only). */
+    const unsigned char * bitmap;
+    int min;
+    int max;
+};
+
+struct bench_stemmer {
+    const char * algorithm;
+    /* "trie" or "packed" for UTF-8 generated with that option, or "8bit"
+     * for a single byte encoding generated with -trie. */
+    const char * form;
+    /* Each list is terminated by an entry with a null name. */
+    const struct bench_among * amongs;
+    const struct bench_grouping * groupings;
+};
+
+/* Terminated by a null pointer. */
+extern const struct bench_stemmer * const runtimebench_stemmers[];
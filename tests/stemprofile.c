@@ -0,0 +1,58 @@
+/* Stem the words read from stdin, one per line, with a stemmer generated
+ * with -profile and -eprefix profile_, then write its among counts to stderr
+ * in the form -profile-use reads.
+ *
+ * The GNUmakefile builds one of these for each algorithm, defining
+ * STEMMER_HEADER to the name of its generated header, for `make profile`.
+ */
+
+#include <stdio.h>
+#include <stdlib.h> /* for malloc, realloc, free */
+
+#include "../runtime/api.h"
+#include STEMMER_HEADER
+
+int main(int argc, char * argv[]) {
+    struct SN_env * z;
+    int size = 64;
+    symbol * word = (symbol *) malloc(size);
+    int len = 0;
+    int ch;
+    (void)argv;
+    if (argc != 1) {
+        fprintf(stderr, "Usage: stemprofile < WORDS 2> PROFILE\n");
+        return 1;
+    }
+    z = profile_create_env();
+    if (word == NULL || z == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+    do {
+        ch = getc(stdin);
+        if (ch == '\n' || ch == EOF) {
+            if (len == 0) continue;
+            if (SN_set_current(z, len, word) < 0 || profile_stem(z) < 0) {
+                fprintf(stderr, "Out of memory\n");
+                return 1;
+            }
+            len = 0;
+            continue;
+        }
+        if (ch == '\r') continue;
+        if (len == size) {
+            symbol * new_word = (symbol *) realloc(word, size * 2);
+            if (new_word == NULL) {
+                fprintf(stderr, "Out of memory\n");
+                return 1;
+            }
+            word = new_word;
+            size *= 2;
+        }
+        word[len++] = (symbol)ch;
+    } while (ch != EOF);
+    profile_dump_profile();
+    profile_close_env(z);
+    free(word);
+    return 0;
+}
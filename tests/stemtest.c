@@ -37,6 +37,9 @@ static const struct testcase {
     { 0, 0, "space1999", 0 },
     { 0, 0, "hal9000", 0 },
     { 0, 0, "0x0e00", 0 },
+    // An empty word should stem to an empty word (and the stem shouldn't be
+    // copied into a buffer which isn't needed).
+    { 0, 0, "", 0 },
     { 0, 0, 0, 0 }
 };
 
@@ -48,7 +51,7 @@ run_testcase(const char * language, const struct testcase *test)
     const char * expect = test->expect;
     struct sb_stemmer * stemmer = sb_stemmer_new(language, charenc);
     const sb_symbol * stemmed;
-    int len;
+    int len, max;
 
     if (expect == NULL) expect = input;
     if (stemmer == 0) {
@@ -72,9 +75,406 @@ run_testcase(const char * language, const struct testcase *test)
                         language, input, len, stemmed, expect);
         exit(1);
     }
+    max = sb_stemmer_max_output(stemmer, (int)strlen(input));
+    if (max != -1 && max < len) {
+        fprintf(stderr, "%s stemmer output for %s longer than bound %d\n",
+                        language, input, max);
+        exit(1);
+    }
+
+    {
+        sb_symbol buf[64];
+        int prefix_len, suffix_len;
+        len = sb_stemmer_stem_into(stemmer, (const sb_symbol *)input,
+                                   strlen(input), buf, sizeof(buf));
+        if (len != (int)strlen(expect) || memcmp(buf, expect, len) != 0) {
+            fprintf(stderr, "%s stemmer output into buffer for %s was %.*s not %s\n",
+                            language, input, len, buf, expect);
+            exit(1);
+        }
+        if (len > 0 &&
+            sb_stemmer_stem_into(stemmer, (const sb_symbol *)input,
+                                 strlen(input), buf, len - 1) != len) {
+            fprintf(stderr, "%s stemmer output into short buffer for %s gave wrong length\n",
+                            language, input);
+            exit(1);
+        }
+        /* Just asking for the length. */
+        if (sb_stemmer_stem_into(stemmer, (const sb_symbol *)input,
+                                 strlen(input), NULL, 0) != len) {
+            fprintf(stderr, "%s stemmer output into no buffer for %s gave wrong length\n",
+                            language, input);
+            exit(1);
+        }
+        stemmed = sb_stemmer_stem_suffix(stemmer, (const sb_symbol *)input,
+                                         strlen(input),
+                                         &prefix_len, &suffix_len);
+        if (stemmed == NULL ||
+            prefix_len + suffix_len != (int)strlen(expect) ||
+            memcmp(input, expect, prefix_len) != 0 ||
+            memcmp(stemmed, expect + prefix_len, suffix_len) != 0) {
+            fprintf(stderr, "%s stemmer suffix edit for %s was wrong\n",
+                            language, input);
+            exit(1);
+        }
+    }
+    sb_stemmer_delete(stemmer);
+}
+
+static void
+run_batch_test(const char * language)
+{
+    static const char * const words[] = {
+        "connection", "connections", "generously", "", "hal9000", "running"
+    };
+    const int count = (int)(sizeof(words) / sizeof(words[0]));
+    struct sb_stemmer * stemmer = sb_stemmer_new(language, NULL);
+    struct sb_stemmer * check = sb_stemmer_new(language, NULL);
+    int sizes[sizeof(words) / sizeof(words[0])];
+    int offsets[sizeof(words) / sizeof(words[0]) + 1];
+    sb_symbol out[256];
+    int i, n;
+
+    for (i = 0; i < count; ++i) sizes[i] = (int)strlen(words[i]);
+    n = sb_stemmer_stem_batch(stemmer, count,
+                              (const sb_symbol * const *)words, sizes,
+                              out, (int)sizeof(out), offsets);
+    if (n != count) {
+        fprintf(stderr, "%s batch stemmer stemmed %d words not %d\n",
+                        language, n, count);
+        exit(1);
+    }
+    for (i = 0; i < count; ++i) {
+        const sb_symbol * stemmed;
+        int len, max;
+        stemmed = sb_stemmer_stem(check, (const sb_symbol *)words[i], sizes[i]);
+        len = sb_stemmer_length(check);
+        if (offsets[i + 1] - offsets[i] != len ||
+            memcmp(out + offsets[i], stemmed, len) != 0) {
+            fprintf(stderr, "%s batch stemmer output for %s was %.*s not %s\n",
+                            language, words[i], offsets[i + 1] - offsets[i],
+                            out + offsets[i], stemmed);
+            exit(1);
+        }
+        max = sb_stemmer_max_output(check, sizes[i]);
+        if (max != -1 && max < len) {
+            fprintf(stderr, "%s stemmer output for %s longer than bound %d\n",
+                            language, words[i], max);
+            exit(1);
+        }
+    }
+
+    /* A buffer which is too small should stop at a word boundary. */
+    n = sb_stemmer_stem_batch(stemmer, count,
+                              (const sb_symbol * const *)words, sizes,
+                              out, offsets[2], offsets);
+    if (n != 2) {
+        fprintf(stderr, "%s batch stemmer with short buffer stemmed %d words not 2\n",
+                        language, n);
+        exit(1);
+    }
+
+    /* Empty stems need no buffer. */
+    n = sb_stemmer_stem_batch(stemmer, 1,
+                              (const sb_symbol * const *)(words + 3), sizes + 3,
+                              NULL, 0, offsets);
+    if (n != 1 || offsets[1] != 0) {
+        fprintf(stderr, "%s batch stemmer with no buffer stemmed %d words not 1\n",
+                        language, n);
+        exit(1);
+    }
+    sb_stemmer_delete(check);
+    sb_stemmer_delete(stemmer);
+}
+
+static void
+run_cache_test(const char * language)
+{
+    static const char * const words[] = {
+        "connection", "connections", "generously", "connection", "",
+        "hal9000", "running", "connections", "running", "runs", "run",
+        "generously", "connection"
+    };
+    const int count = (int)(sizeof(words) / sizeof(words[0]));
+    /* Use a small cache so that it has to be emptied along the way. */
+    struct sb_stemmer * stemmer = sb_stemmer_new_cached(language, NULL, 4);
+    struct sb_stemmer * check = sb_stemmer_new(language, NULL);
+    unsigned long hits, misses;
+    int pass, i;
+
+    for (pass = 0; pass < 2; ++pass) {
+        for (i = 0; i < count; ++i) {
+            const sb_symbol * stemmed, * expect;
+            int len, size = (int)strlen(words[i]);
+            stemmed = sb_stemmer_stem(stemmer, (const sb_symbol *)words[i], size);
+            expect = sb_stemmer_stem(check, (const sb_symbol *)words[i], size);
+            len = sb_stemmer_length(stemmer);
+            if (stemmed == NULL ||
+                len != sb_stemmer_length(check) ||
+                memcmp(stemmed, expect, len + 1) != 0) {
+                fprintf(stderr, "%s cached stemmer output for %s was %s not %s\n",
+                                language, words[i], stemmed, expect);
+                exit(1);
+            }
+        }
+    }
+    sb_stemmer_cache_stats(stemmer, &hits, &misses);
+    if (hits == 0 || hits + misses != 2 * (unsigned long)count) {
+        fprintf(stderr, "%s cached stemmer reported %lu hits and %lu misses\n",
+                        language, hits, misses);
+        exit(1);
+    }
+    /* An empty word may be passed as NULL, both when it's added to the
+     * cache and when it's found there. */
+    for (pass = 0; pass < 2; ++pass) {
+        if (sb_stemmer_stem(stemmer, NULL, 0) == NULL ||
+            sb_stemmer_length(stemmer) != 0) {
+            fprintf(stderr, "%s cached stemmer failed on a NULL empty word\n",
+                            language);
+            exit(1);
+        }
+    }
+    sb_stemmer_delete(check);
+    sb_stemmer_delete(stemmer);
+}
+
+struct text_token {
+    int offset;
+    int length;
+    /* The token folded to lower case. */
+    const char * folded;
+};
+
+struct text_state {
+    struct sb_stemmer * check;
+    const struct text_token * expect;
+    int count;
+    int stop_after;
+};
+
+static int
+text_callback(void * context, int offset, int length,
+              const sb_symbol * stem, int stem_length)
+{
+    struct text_state * state = (struct text_state *)context;
+    const struct text_token * e = state->expect + state->count;
+    const sb_symbol * expect_stem;
+    expect_stem = sb_stemmer_stem(state->check, (const sb_symbol *)e->folded,
+                                  (int)strlen(e->folded));
+    if (offset != e->offset || length != e->length ||
+        stem_length != sb_stemmer_length(state->check) ||
+        memcmp(stem, expect_stem, stem_length) != 0) {
+        fprintf(stderr, "text token %d was at %d+%d with stem %.*s, not at %d+%d with stem %s\n",
+                        state->count, offset, length, stem_length, stem,
+                        e->offset, e->length, expect_stem);
+        exit(1);
+    }
+    return ++state->count == state->stop_after;
+}
+
+static void
+run_text_test(void)
+{
+    static const char text[] =
+        "The CATS' Running-dogs, don't \xc3\x89T\xc3\x89S 1984";
+    static const struct text_token tokens[] = {
+        { 0, 3, "the" },
+        { 4, 4, "cats" },
+        { 10, 7, "running" },
+        { 18, 4, "dogs" },
+        { 24, 5, "don't" },
+        { 30, 6, "\xc3\xa9t\xc3\xa9s" },
+        { 37, 4, "1984" }
+    };
+    const int count = (int)(sizeof(tokens) / sizeof(tokens[0]));
+    static const char invalid_text[] =
+        "ab" "\xe0\x80\x80" "cd" "\xed\xa0\x80" "ef" "\xf0\x80\x80\x80" "gh"
+        "\xf4\x90\x80\x80" "ij";
+    static const struct text_token invalid_tokens[] = {
+        { 0, 2, "ab" },
+        { 5, 2, "cd" },
+        { 10, 2, "ef" },
+        { 16, 2, "gh" },
+        { 22, 2, "ij" }
+    };
+    const int invalid_count = (int)(sizeof(invalid_tokens) / sizeof(invalid_tokens[0]));
+    struct sb_stemmer * stemmer = sb_stemmer_new("english", NULL);
+    struct text_state state;
+    int n;
+
+    state.check = sb_stemmer_new("english", NULL);
+    state.expect = tokens;
+    state.count = 0;
+    state.stop_after = -1;
+    n = sb_stemmer_stem_text(stemmer, (const sb_symbol *)text,
+                             (int)strlen(text), text_callback, &state);
+    if (n != count || state.count != count) {
+        fprintf(stderr, "text stemming found %d tokens not %d\n", n, count);
+        exit(1);
+    }
+
+    /* The callback can stop the scan early. */
+    state.count = 0;
+    state.stop_after = 2;
+    n = sb_stemmer_stem_text(stemmer, (const sb_symbol *)text,
+                             (int)strlen(text), text_callback, &state);
+    if (n != 2 || state.count != 2) {
+        fprintf(stderr, "text stemming didn't stop when asked\n");
+        exit(1);
+    }
+
+    /* Invalid UTF-8 separates words: an overlong encoding of U+0800, the
+     * surrogate U+D800, an overlong encoding of U+10000 and U+110000. */
+    state.expect = invalid_tokens;
+    state.count = 0;
+    state.stop_after = -1;
+    n = sb_stemmer_stem_text(stemmer, (const sb_symbol *)invalid_text,
+                             (int)strlen(invalid_text), text_callback, &state);
+    if (n != invalid_count || state.count != invalid_count) {
+        fprintf(stderr, "text stemming found %d tokens in invalid UTF-8 not %d\n",
+                n, invalid_count);
+        exit(1);
+    }
+    sb_stemmer_delete(state.check);
     sb_stemmer_delete(stemmer);
 }
 
+static void
+run_pool_test(void)
+{
+    struct sb_stemmer_pool * pool = sb_stemmer_pool_new("english", NULL, 1);
+    struct sb_stemmer * a, * b;
+    const sb_symbol * stemmed;
+    if (pool == NULL) {
+        fprintf(stderr, "failed to create stemmer pool\n");
+        exit(1);
+    }
+    a = sb_stemmer_pool_acquire(pool);
+    b = sb_stemmer_pool_acquire(pool);
+    if (a == NULL || b == NULL || a == b) {
+        fprintf(stderr, "stemmer pool handed out the same stemmer twice\n");
+        exit(1);
+    }
+    stemmed = sb_stemmer_stem(a, (const sb_symbol *)"connections", 11);
+    if (stemmed == NULL || strcmp((const char *)stemmed, "connect") != 0) {
+        fprintf(stderr, "stemmer from pool gave wrong output\n");
+        exit(1);
+    }
+    sb_stemmer_pool_release(pool, a);
+    /* The pool only has room for one, so this one should get deleted. */
+    sb_stemmer_pool_release(pool, b);
+    if (sb_stemmer_pool_acquire(pool) != a) {
+        fprintf(stderr, "stemmer pool didn't reuse released stemmer\n");
+        exit(1);
+    }
+    sb_stemmer_pool_release(pool, a);
+    sb_stemmer_pool_delete(pool);
+
+    if (sb_stemmer_pool_new("e", NULL, 1) != NULL) {
+        fprintf(stderr, "stemmer pool created for unrecognised language\n");
+        exit(1);
+    }
+}
+
+static void
+run_stats_test(void)
+{
+    static const char * const words[] = {
+        "connections", "run", "connections"
+    };
+    struct sb_stemmer * stemmer = sb_stemmer_new_cached("english", NULL, 16);
+    struct sb_stemmer_stats stats;
+    sb_symbol long_word[200];
+    int i;
+
+    for (i = 0; i < 3; ++i) {
+        sb_stemmer_stem(stemmer, (const sb_symbol *)words[i],
+                        (int)strlen(words[i]));
+    }
+    /* This is too long for the initial buffer, so it has to grow (or with
+     * SN_MAX_WORD_LENGTH, it's returned unchanged instead). */
+    memset(long_word, 'a', sizeof(long_word));
+    sb_stemmer_stem(stemmer, long_word, (int)sizeof(long_word));
+
+    sb_stemmer_stats(stemmer, &stats);
+    if (stats.words != 4 ||
+        stats.input_bytes != 25 + sizeof(long_word) ||
+        stats.output_bytes != 17 + sizeof(long_word) ||
+        stats.unchanged != 2 ||
+#if defined SN_MAX_WORD_LENGTH && SN_MAX_WORD_LENGTH < 200
+        stats.reallocs != 0 ||
+#else
+        stats.reallocs == 0 ||
+#endif
+        stats.cache_hits != 1 || stats.cache_misses != 3 ||
+        stats.seconds != 0) {
+        fprintf(stderr, "stemmer stats were %lu words, %lu bytes in, "
+                        "%lu bytes out, %lu unchanged, %lu reallocs, "
+                        "%lu hits, %lu misses, %g seconds\n",
+                        stats.words, stats.input_bytes, stats.output_bytes,
+                        stats.unchanged, stats.reallocs, stats.cache_hits,
+                        stats.cache_misses, stats.seconds);
+        exit(1);
+    }
+
+    sb_stemmer_reset_stats(stemmer);
+    sb_stemmer_time_stats(stemmer, 1);
+    sb_stemmer_stem(stemmer, (const sb_symbol *)"running", 7);
+    sb_stemmer_stats(stemmer, &stats);
+    if (stats.words != 1 || stats.input_bytes != 7 ||
+        stats.output_bytes != 3 || stats.unchanged != 0 ||
+        stats.reallocs != 0 ||
+        stats.cache_hits != 0 || stats.cache_misses != 1 ||
+        stats.seconds < 0) {
+        fprintf(stderr, "stemmer stats weren't reset\n");
+        exit(1);
+    }
+    sb_stemmer_delete(stemmer);
+}
+
+#ifdef SN_MAX_WORD_LENGTH
+/* Test that words which don't fit in the fixed-size buffers are returned
+ * unchanged, and that the stemmer still works afterwards. */
+static void
+run_max_length_test(const char * language)
+{
+    struct sb_stemmer * stemmer = sb_stemmer_new(language, NULL);
+    sb_symbol long_word[SN_MAX_WORD_LENGTH + 1];
+    sb_symbol out[SN_MAX_WORD_LENGTH + 5];
+    const sb_symbol * const words[2] = { long_word, (const sb_symbol *)"2000" };
+    const int sizes[2] = { (int)sizeof(long_word), 4 };
+    int offsets[3];
+    const sb_symbol * stemmed;
+    struct sb_stemmer_stats stats;
+
+    memset(long_word, 'a', sizeof(long_word));
+    long_word[sizeof(long_word) - 1] = 's';
+    stemmed = sb_stemmer_stem(stemmer, long_word, (int)sizeof(long_word));
+    if (stemmed == NULL ||
+        sb_stemmer_length(stemmer) != (int)sizeof(long_word) ||
+        memcmp(stemmed, long_word, sizeof(long_word)) != 0) {
+        fprintf(stderr, "%s: word longer than SN_MAX_WORD_LENGTH changed\n",
+                language);
+        exit(1);
+    }
+    if (sb_stemmer_stem_batch(stemmer, 2, words, sizes, out, (int)sizeof(out),
+                              offsets) != 2 ||
+        offsets[1] != (int)sizeof(long_word) || offsets[2] != offsets[1] + 4 ||
+        memcmp(out + offsets[1], "2000", 4) != 0) {
+        fprintf(stderr, "%s: batch stemming with a long word failed\n",
+                language);
+        exit(1);
+    }
+    sb_stemmer_stats(stemmer, &stats);
+    if (stats.reallocs != 0) {
+        fprintf(stderr, "%s: buffer grown with SN_MAX_WORD_LENGTH\n",
+                language);
+        exit(1);
+    }
+    sb_stemmer_delete(stemmer);
+}
+#endif
+
 int
 main(int argc, char * argv[])
 {
@@ -94,5 +494,20 @@ main(int argc, char * argv[])
         }
     }
 
+    {
+        const char ** l;
+        for (l = all_languages; *l; ++l) {
+            run_batch_test(*l);
+            run_cache_test(*l);
+#ifdef SN_MAX_WORD_LENGTH
+            run_max_length_test(*l);
+#endif
+        }
+    }
+
+    run_pool_test();
+    run_text_test();
+    run_stats_test();
+
     return 0;
 }